@@ -5,7 +5,7 @@
 
 int thisAddr = 42;
 
-void ReceiveSetLeverState(ilmsg::MessageSetLeverState msg)
+void ReceiveSetLeverState(const ilmsg::MessageSetLeverState& msg)
 {
   Serial.println("Received lever state");
   Serial.print("Device id: ");
@@ -19,7 +19,7 @@ void setup()
 
   ilmsg::Processor.RegisterDevice(ilmsg::ModuleType::Lever, thisAddr);
   //ilmsg::Processor.SetFilter(ilmsg::ModuleType::Lever, thisAddr);
-  ilmsg::Processor.OnMessage(ilmsg::MessageType::SetLeverState, new ilmsg::MessageProcessFunc<ilmsg::MessageSetLeverState>(ReceiveSetLeverState));
+  ilmsg::Processor.OnMessage(ReceiveSetLeverState);
 #ifdef _FEATHER
   if (ilmsg::Processor.Start(19, 22))
 #else
@@ -0,0 +1,105 @@
+/**
+* Host tools, shared frame loading
+* Author: Kyle Sarnik
+*
+* Loads an interlocking config the same way the core does, for tools built
+* on a host with ENV_ARDUINO=0.
+**/
+
+#pragma once
+
+#include <CommonLib.h>
+#include <iLock.h>
+#include <JSONLoader.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace host
+{
+
+using lib::String;
+using lib::Vector;
+
+//! Interlocking loaded from a config file
+struct Frame
+{
+	ilock::Interlocking il;
+	Vector<JSONLoader::LeverData> levers;
+	Vector<JSONLoader::InterlockingData> rules;
+	Vector<JSONLoader::RouteData> routes;
+};
+
+//! Compile the lock graph of the interlocking. Revisions of iLock from before Compile() have
+//! nothing to compile, so tools can also be built against them for comparison.
+template <class T>
+inline auto Compile(T& il, int) -> decltype(il.Compile(), void())
+{
+	il.Compile();
+}
+
+template <class T>
+inline void Compile(T&, long)
+{
+}
+
+template <class T>
+inline void Compile(T& il)
+{
+	Compile(il, 0);
+}
+
+//! Load config file into the frame, finalize and compile it. Returns false on error.
+inline bool LoadFrame(const char* path, Frame& frame)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		fprintf(stderr, "error: cannot open config file %s\n", path);
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+
+	DynamicJsonDocument doc(1 << 16);
+	DeserializationError err = deserializeJson(doc, contents.str());
+	if (err)
+	{
+		fprintf(stderr, "error: JSON deserialize error: %s\n", err.c_str());
+		return false;
+	}
+
+	JSONLoader::JSONLoader loader(doc);
+	frame.levers = loader.GetLeverData();
+	frame.rules = loader.GetInterlockingData();
+	frame.routes = loader.GetRouteData();
+
+	for (auto& data : frame.levers)
+	{
+		frame.il.AddLever(data.name);
+	}
+
+	for (auto& data : frame.rules)
+	{
+		ilock::Locking* leverActing = frame.il.GetLocking(data.actingLever);
+		ilock::Locking* leverAffected = frame.il.GetLocking(data.affectedLever);
+		if (!leverActing || !leverAffected)
+		{
+			fprintf(stderr, "error: lock rule %s -> %s references an unknown lever\n",
+				data.actingLever.c_str(), data.affectedLever.c_str());
+			return false;
+		}
+		leverActing->AddLockRule(ilock::LockState::On, leverAffected->GetId(), (ilock::LockingRule)(lib::byte)data.ruleOn);
+		leverActing->AddLockRule(ilock::LockState::Off, leverAffected->GetId(), (ilock::LockingRule)(lib::byte)data.ruleOff);
+	}
+
+	for (ilock::LockingId lid : frame.il.GetAllLockings())
+	{
+		frame.il.GetLocking(lid)->FinalizeLockRules();
+	}
+	Compile(frame.il);
+	return true;
+}
+
+} // namespace host
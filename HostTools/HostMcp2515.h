@@ -0,0 +1,222 @@
+/**
+* Host tools, simulated MCP2515
+* Author: Kyle Sarnik
+*
+* Register file and SPI instruction set of the MCP2515, enough for the CAN
+* library driver. Frames are delivered into the RX buffers by the tool and the
+* bus only moves when BusTick runs, or at once when autoSend is set.
+**/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace host
+{
+
+//! Frame seen on the simulated bus
+struct SimFrame
+{
+	uint32_t id = 0;
+	bool extended = false;
+	uint8_t dlc = 0;
+	uint8_t data[8] = {};
+	int buffer = 0;
+};
+
+class Mcp2515Sim
+{
+public:
+	static constexpr uint8_t RegCanIntf = 0x2c;
+	static constexpr uint8_t TxReq = 0x08;
+
+	static constexpr uint8_t TxCtrl(int n) { return 0x30 + n * 0x10; }
+	static constexpr uint8_t RxHeader(int n) { return 0x61 + n * 0x10; }
+
+	//! Register file
+	uint8_t reg[128] = {};
+
+	//! SPI transactions started
+	long transactions = 0;
+
+	//! Chip select pin, set by the tool to match CAN.setPins
+	int csPin = 10;
+
+	//! Frames are acknowledged by the bus
+	bool ack = true;
+
+	//! Send requested buffers as soon as chip select rises
+	bool autoSend = true;
+
+	//! Frames sent, in bus order
+	std::vector<SimFrame> sent;
+
+	//! Frames the tool could not deliver because both RX buffers were full
+	long rxLost = 0;
+
+	//! Put a frame into a free RX buffer, false when both are full
+	bool Deliver(uint32_t id, const uint8_t* data, uint8_t dlc)
+	{
+		int n = !(reg[RegCanIntf] & 0x01) ? 0 : !(reg[RegCanIntf] & 0x02) ? 1 : -1;
+		if (n < 0)
+		{
+			rxLost++;
+			return false;
+		}
+
+		uint8_t* r = reg + RxHeader(n);
+		uint32_t idA = (id >> 18) & 0x7ff;
+		uint32_t idB = id & 0x3ffff;
+		r[0] = idA >> 3;
+		r[1] = ((idA & 0x07) << 5) | 0x08 | ((idB >> 16) & 0x03);
+		r[2] = (idB >> 8) & 0xff;
+		r[3] = idB & 0xff;
+		r[4] = dlc & 0x0f;
+		memcpy(r + 5, data, dlc > 8 ? 8 : dlc);
+
+		reg[RegCanIntf] |= 0x01 << n;
+		return true;
+	}
+
+	//! Number of full RX buffers
+	int RxFull() const { return ((reg[RegCanIntf] & 0x01) ? 1 : 0) + ((reg[RegCanIntf] & 0x02) ? 1 : 0); }
+
+	//! Send the requested buffer the chip would pick next, false when none is requested
+	bool BusTick()
+	{
+		int best = -1;
+		for (int n = 0; n < 3; n++)
+		{
+			if (!(reg[TxCtrl(n)] & TxReq))
+				continue;
+
+			// highest TXP wins, then the highest buffer number
+			if (best < 0 || (reg[TxCtrl(n)] & 0x03) >= (reg[TxCtrl(best)] & 0x03))
+				best = n;
+		}
+
+		if (best < 0 || !ack)
+			return false;
+
+		uint8_t* r = reg + TxCtrl(best) + 1;
+		SimFrame frame;
+		frame.extended = (r[1] & 0x08) != 0;
+		if (frame.extended)
+			frame.id = ((uint32_t)r[0] << 21) | ((uint32_t)(r[1] >> 5) << 18) | ((uint32_t)(r[1] & 0x03) << 16) | (r[2] << 8) | r[3];
+		else
+			frame.id = ((uint32_t)r[0] << 3) | (r[1] >> 5);
+		frame.dlc = r[4] & 0x0f;
+		memcpy(frame.data, r + 5, 8);
+		frame.buffer = best;
+		sent.push_back(frame);
+
+		reg[TxCtrl(best)] &= ~TxReq;
+		reg[RegCanIntf] |= 0x04 << best;
+		return true;
+	}
+
+	//! Chip select edge
+	void Select(bool selected)
+	{
+		if (selected)
+		{
+			_command.clear();
+			return;
+		}
+
+		if (_command.empty())
+			return;
+
+		uint8_t c = _command[0];
+		if ((c & 0xf9) == 0x90)
+			reg[RegCanIntf] &= ~(0x01 << ((c >> 2) & 0x01));
+		else if ((c & 0xf8) == 0x80)
+		{
+			for (int n = 0; n < 3; n++)
+				if (c & (0x01 << n))
+					reg[TxCtrl(n)] |= TxReq;
+		}
+		else if (c == 0xc0)
+			memset(reg, 0, sizeof(reg));
+
+		if (autoSend)
+			while (BusTick()) {}
+	}
+
+	//! Byte clocked in while selected, returns the byte clocked out
+	uint8_t Transfer(uint8_t value)
+	{
+		_command.push_back(value);
+		uint8_t c = _command[0];
+		size_t k = _command.size();
+
+		if (k == 1)
+		{
+			if ((c & 0xf9) == 0x90)
+				_address = RxHeader((c >> 2) & 0x01) + ((c & 0x02) ? 5 : 0);
+			return 0;
+		}
+
+		switch (c)
+		{
+		case 0x03:
+			if (k == 2)
+			{
+				_address = value;
+				return 0;
+			}
+			return reg[_address++ & 0x7f];
+		case 0x02:
+			if (k == 2)
+				_address = value;
+			else
+				reg[_address++ & 0x7f] = value;
+			return 0;
+		case 0x05:
+			if (k == 4)
+			{
+				uint8_t& r = reg[_command[1] & 0x7f];
+				r = (r & ~_command[2]) | (value & _command[2]);
+			}
+			return 0;
+		case 0xa0:
+			return ReadStatus();
+		default:
+			if ((c & 0xf9) == 0x90)
+				return reg[_address++ & 0x7f];
+			return 0;
+		}
+	}
+
+private:
+	std::vector<uint8_t> _command;
+	uint8_t _address = 0;
+
+	uint8_t ReadStatus() const
+	{
+		uint8_t intf = reg[RegCanIntf];
+		uint8_t status = intf & 0x03;
+		for (int n = 0; n < 3; n++)
+		{
+			if (reg[TxCtrl(n)] & TxReq)
+				status |= 0x04 << (n * 2);
+			if (intf & (0x04 << n))
+				status |= 0x08 << (n * 2);
+		}
+		return status;
+	}
+};
+
+//! The chip behind the SPI stand-in
+inline Mcp2515Sim Chip;
+
+//! Pin written by digitalWrite
+inline void PinWritten(int pin, int value)
+{
+	if (pin == Chip.csPin)
+		Chip.Select(value == 0);
+}
+
+} // namespace host
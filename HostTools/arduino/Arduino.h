@@ -0,0 +1,99 @@
+/**
+* Host tools, Arduino core stand-in
+* Author: Kyle Sarnik
+*
+* Just enough of the Arduino core to build the CAN stack on a host. Time only
+* moves when a tool advances it, pins are plain variables and pin writes are
+* forwarded to the simulated chip in HostMcp2515.h, which watches its select.
+**/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+typedef std::string String;
+
+#define HEX 16
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define MSBFIRST 1
+
+namespace host
+{
+
+//! Current time in microseconds, advanced by the tool
+inline unsigned long nowMicros = 0;
+
+//! Advance the time in milliseconds
+inline void Advance(unsigned long ms) { nowMicros += ms * 1000; }
+
+//! Level of each pin
+inline int pinLevels[256];
+
+//! Handler attached to each interrupt
+inline void (*interruptHandlers[256])() = {};
+
+//! Run the handler attached to an interrupt, as the pin would
+inline void FireInterrupt(int irq)
+{
+	if (irq >= 0 && irq < 256 && interruptHandlers[irq])
+		interruptHandlers[irq]();
+}
+
+} // namespace host
+
+#include "../HostMcp2515.h"
+
+inline unsigned long millis() { return host::nowMicros / 1000; }
+inline unsigned long micros() { return host::nowMicros; }
+inline void delay(unsigned long ms) { host::Advance(ms); }
+inline void delayMicroseconds(unsigned int us) { host::nowMicros += us; }
+inline void yield() {}
+
+inline void pinMode(int, int) {}
+inline int digitalRead(int pin) { return host::pinLevels[pin & 0xFF]; }
+inline void digitalWrite(int pin, int value)
+{
+	host::pinLevels[pin & 0xFF] = value;
+	host::PinWritten(pin, value);
+}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int irq, void (*handler)(), int) { host::interruptHandlers[irq & 0xFF] = handler; }
+inline void detachInterrupt(int irq) { host::interruptHandlers[irq & 0xFF] = nullptr; }
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			write(buffer[i]);
+		return size;
+	}
+
+	void print(const char*) {}
+	void print(char) {}
+	void print(int, int = 10) {}
+	void println(const char*) {}
+	void println(int, int = 10) {}
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+	virtual void flush() {}
+	void setTimeout(unsigned long) {}
+};
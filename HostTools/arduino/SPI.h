@@ -0,0 +1,32 @@
+/**
+* Host tools, SPI stand-in
+* Author: Kyle Sarnik
+*
+* Forwards every byte to the simulated MCP2515 and counts transactions.
+**/
+
+#pragma once
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0
+
+struct SPISettings
+{
+	SPISettings() {}
+	SPISettings(uint32_t, int, int) {}
+};
+
+class SPIClass
+{
+public:
+	void begin() {}
+	void end() {}
+	void beginTransaction(SPISettings) { host::Chip.transactions++; }
+	void endTransaction() {}
+	uint8_t transfer(uint8_t value) { return host::Chip.Transfer(value); }
+	void usingInterrupt(int) {}
+	void notUsingInterrupt(int) {}
+};
+
+inline SPIClass SPI;
@@ -0,0 +1,8 @@
+/**
+* Host tools, Arduino core stand-in under the name CommonLib includes
+* Author: Kyle Sarnik
+**/
+
+#pragma once
+
+#include "Arduino.h"
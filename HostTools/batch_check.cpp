@@ -0,0 +1,179 @@
+/**
+* Batched lock change check
+* Author: Kyle Sarnik
+*
+* Applies random batches of lever moves and throws to a frame inside
+* BeginBatch and CommitBatch, some of them nested, and checks the lock change
+* callbacks of each commit against the locked state of every ID before and
+* after the batch. The same moves run unbatched on a second copy of the frame
+* to count the callbacks the batches save.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/batch_check.cpp
+*       libraries/iLock/src/iLock.cpp libraries/JSONLoader/src/JSONLoader.cpp -o batch_check
+* Usage:
+*   batch_check [config file] [batches]
+**/
+
+#include "HostFrame.h"
+
+#include <random>
+
+using lib::Vector;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+
+static int failures = 0;
+
+//! Report a failed check
+void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//! Batched frame and the callbacks it emitted since the last batch began
+host::Frame batched;
+struct LockChangeCall
+{
+	LockingId lid;
+	bool locked;
+};
+Vector<LockChangeCall> calls;
+long callsInBatch = 0;
+
+void BatchedLockChanged(LockingId lid, bool locked)
+{
+	if (batched.il.InBatch())
+		callsInBatch++;
+	calls.push_back({ lid, locked });
+}
+
+//! Unbatched copy of the frame, only counts its callbacks
+host::Frame unbatched;
+long unbatchedCalls = 0;
+
+void UnbatchedLockChanged(LockingId lid, bool locked)
+{
+	unbatchedCalls++;
+}
+
+//! Apply a move or throw to the same lever of both frames
+void Move(LockingId lid, bool isThrow, LeverState state)
+{
+	for (ilock::Interlocking* il : { &batched.il, &unbatched.il })
+	{
+		ilock::Lever* lever = static_cast<ilock::Lever*>(il->GetLocking(lid));
+		if (isThrow)
+			lever->ThrowLever();
+		else
+			lever->SetLeverState(state);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	long count = argc > 2 ? atol(argv[2]) : 100000;
+	if (count <= 0)
+		count = 100000;
+
+	if (!host::LoadFrame(path, batched) || !host::LoadFrame(path, unbatched))
+		return 1;
+	batched.il.OnLockChange(BatchedLockChanged);
+	unbatched.il.OnLockChange(UnbatchedLockChanged);
+
+	Vector<LockingId> ids = batched.il.GetAllLockings();
+	Vector<LockingId> levers;
+	for (LockingId lid : ids)
+	{
+		if (batched.il.GetLocking(lid)->IsLever())
+			levers.push_back(lid);
+	}
+
+	std::mt19937 rng(5);
+	Vector<bool> before(ids.size());
+	Vector<int> reported(ids.back() + 1);
+	bool once = true, final = true, complete = true, matches = true;
+	long batchCalls = 0, moves = 0;
+
+	for (long b = 0; b < count; b++)
+	{
+		for (size_t i = 0; i < ids.size(); i++)
+			before[i] = batched.il.GetLocking(ids[i])->IsLocked();
+		calls.clear();
+
+		// 1 to 5 moves, the later ones in a nested batch one time in four
+		int batchMoves = 1 + rng() % 5;
+		bool nested = rng() % 4 == 0;
+		batched.il.BeginBatch();
+		for (int m = 0; m < batchMoves; m++)
+		{
+			if (nested && m == batchMoves / 2)
+				batched.il.BeginBatch();
+
+			// Put a faulted lever back half the time, otherwise the fault gate holds every lever locked
+			LockingId lid = levers[rng() % levers.size()];
+			bool isThrow = rng() % 3 == 0;
+			LeverState state = (rng() & 1) ? LeverState::Reversed : LeverState::Normal;
+			if (batched.il.GetFaultedCount() > 0 && (rng() & 1))
+			{
+				for (LockingId faulted : levers)
+				{
+					ilock::Lever* lever = static_cast<ilock::Lever*>(batched.il.GetLocking(faulted));
+					if (lever->IsFaulted())
+					{
+						lid = faulted;
+						isThrow = false;
+						state = lever->GetState() == LockState::On ? LeverState::Normal : LeverState::Reversed;
+						break;
+					}
+				}
+			}
+			Move(lid, isThrow, state);
+			moves++;
+		}
+		if (nested)
+		{
+			batched.il.CommitBatch();
+			Check(calls.empty(), "an inner commit emits nothing");
+		}
+		batched.il.CommitBatch();
+		batchCalls += calls.size();
+
+		for (int& n : reported)
+			n = 0;
+		for (const LockChangeCall& call : calls)
+		{
+			once &= ++reported[call.lid] == 1;
+			final &= call.locked == batched.il.GetLocking(call.lid)->IsLocked();
+		}
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			bool changed = batched.il.GetLocking(ids[i])->IsLocked() != before[i];
+			complete &= reported[ids[i]] == (changed ? 1 : 0);
+			matches &= batched.il.GetLocking(ids[i])->IsLocked() == unbatched.il.GetLocking(ids[i])->IsLocked();
+		}
+	}
+
+	printf("%s: %d IDs, %ld batches, %ld moves\n", path, (int)ids.size(), count, moves);
+	printf("%ld callbacks batched, %ld unbatched\n", batchCalls, unbatchedCalls);
+	Check(callsInBatch == 0, "no callback fires while a batch is open");
+	Check(once, "a commit reports each ID at most once");
+	Check(final, "each callback carries the final locked state");
+	Check(complete, "every net lock change is reported, and nothing else");
+	Check(matches, "batching does not change the locked states");
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
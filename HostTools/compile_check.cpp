@@ -0,0 +1,128 @@
+/**
+* Lock graph compile checks
+* Author: Kyle Sarnik
+*
+* Builds frames whose levers apply lock rules to many others, one with more
+* edges than a compiled lock graph holds and one within the limit. Each frame
+* is built twice, one compiled and one left on the uncompiled path, and both
+* get the same random lever moves. The locked state and state of every lever
+* must match after each move, and the oversized frame must stay uncompiled.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       HostTools/compile_check.cpp libraries/iLock/src/iLock.cpp -o compile_check
+* Usage:
+*   compile_check [moves]
+**/
+
+#include <iLock.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using lib::Vector;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+
+static int failures = 0;
+
+//! Report a failed check
+void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//! Build a frame where each lever holds a rule entry for the next span levers. Reversing a lever
+//! locks the next 3 normal, the other entries are unlocked in both states but still make edges.
+void BuildFrame(ilock::Interlocking& il, int levers, int span)
+{
+	Vector<ilock::Lever*> all;
+	for (int i = 0; i < levers; i++)
+		all.push_back(il.AddLever(std::to_string(i)));
+
+	for (int i = 0; i < levers; i++)
+	{
+		for (int k = 1; k <= span; k++)
+		{
+			LockingId target = all[(i + k) % levers]->GetId();
+			all[i]->AddLockRule(LockState::Off, target, k <= 3 ? ilock::LockedOn : ilock::Unlocked);
+			all[i]->AddLockRule(LockState::On, target, ilock::Unlocked);
+		}
+	}
+	for (ilock::Lever* lever : all)
+		lever->FinalizeLockRules();
+}
+
+//! Move random levers of both frames, returns the number of moves after which they differed
+long Diff(ilock::Interlocking& compiled, ilock::Interlocking& rules, int levers, long moves)
+{
+	std::mt19937 rng(13);
+	long mismatches = 0;
+	for (long m = 0; m < moves; m++)
+	{
+		LockingId lid = (LockingId)(1 + rng() % levers);
+		ilock::Lever* lever = static_cast<ilock::Lever*>(rules.GetLocking(lid));
+
+		// Only free levers are moved, so no fault holds the frame
+		if (lever->IsLocked())
+			continue;
+		LeverState state = lever->GetLeverState() == LeverState::Normal ? LeverState::Reversed : LeverState::Normal;
+		lever->SetLeverState(state);
+		static_cast<ilock::Lever*>(compiled.GetLocking(lid))->SetLeverState(state);
+
+		bool same = compiled.GetFaultedCount() == rules.GetFaultedCount();
+		for (int i = 1; i <= levers; i++)
+		{
+			ilock::Locking* a = compiled.GetLocking((LockingId)i);
+			ilock::Locking* b = rules.GetLocking((LockingId)i);
+			same &= a->IsLocked() == b->IsLocked() && a->GetState() == b->GetState();
+		}
+		mismatches += !same;
+	}
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	long moves = argc > 1 ? atol(argv[1]) : 200000;
+	if (moves <= 0)
+		moves = 200000;
+
+	// 255 levers with entries for 200 others make 102000 edges, 120 others make 61200
+	const int Levers = 255;
+	const int spans[] = { 200, 120 };
+	for (int span : spans)
+	{
+		ilock::Interlocking compiled, rules;
+		BuildFrame(compiled, Levers, span);
+		BuildFrame(rules, Levers, span);
+		size_t edges = (size_t)Levers * span * 2;
+		bool fits = edges <= ilock::Interlocking::MaxEdges;
+
+		bool result = compiled.Compile();
+		long mismatches = Diff(compiled, rules, Levers, moves);
+		printf("%d levers, %zu edges: Compile %s, %s, %ld moves, %ld mismatches\n", Levers, edges,
+			result ? "true" : "false", compiled.IsCompiled() ? "compiled" : "uncompiled", moves, mismatches);
+
+		if (fits)
+			Check(result && compiled.IsCompiled(), "a graph within the limit compiles");
+		else
+			Check(!result && !compiled.IsCompiled(), "a graph over the limit stays uncompiled");
+		Check(mismatches == 0, "the compiled frame moves like the uncompiled one");
+	}
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,216 @@
+/**
+* Lever communication checks
+* Author: Kyle Sarnik
+*
+* Runs the lever com manager of the core over the simulated MCP2515 with a
+* two lever interlocking, where reversing A locks B normal. Lever moves are
+* delivered as module messages and the lock state frames sent back are decoded
+* into what the lever module would show. A locked lever which is thrown must
+* keep its lock state, so the module sees the mismatch and shows the fault.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DARDUINO=100 -IHostTools/arduino -Ilibraries/CAN/src
+*       -Ilibraries/CommonLib/src -Ilibraries/iLock/src -Ilibraries/InterlockMessage2/src
+*       -Ilibraries/LeverCom2/src HostTools/levercom_check.cpp libraries/CAN/src/MCP2515.cpp
+*       libraries/CAN/src/CANController.cpp libraries/InterlockMessage2/src/can_mcp2515.cpp
+*       libraries/InterlockMessage2/src/ilmsg2.cpp libraries/iLock/src/iLock.cpp
+*       libraries/LeverCom2/src/levercom2.cpp -o levercom_check
+* Usage:
+*   levercom_check
+**/
+
+#include "HostMcp2515.h"
+
+#include <levercom2.h>
+
+#include <cstdio>
+
+using host::Chip;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+using levercom::LeverManager;
+
+constexpr ilmsg::DeviceId ModuleAddress = 1;
+constexpr int SlotCount = 2;
+
+static int failures = 0;
+
+//! Report a failed check
+void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//! Interlocking under test, lever A in slot 0 and B in slot 1
+ilock::Interlocking il;
+ilock::Lever* levers[SlotCount];
+
+//! What the lever module knows, its own lever positions and the lock states it was sent
+struct ModuleSlot
+{
+	LeverState position = LeverState::Normal;
+	LockState lockState = LockState::On;
+	bool locked = false;
+	int updates = 0;
+
+	//! The module flashes a lever whose position does not match its lock state
+	bool ShowsFault() const { return (position == LeverState::Normal) != (lockState == LockState::On); }
+};
+ModuleSlot module[SlotCount];
+
+//! Callback of the core, applies a reported lever move to the interlocking
+bool LeverStateChanged(LockingId lid, LeverState newState, LockState& lockState)
+{
+	ilock::Lever* lever = static_cast<ilock::Lever*>(il.GetLocking(lid));
+	lever->SetLeverState(newState);
+	lockState = lever->GetState();
+	return !lever->IsFaulted();
+}
+
+//! Lock change callback of the core
+void LeverLockChanged(LockingId lid, bool locked)
+{
+	LeverManager.SetLeverLockState(lid, locked);
+}
+
+//! Decode the frames sent to the module since the last call
+void ReceiveOnModule()
+{
+	for (const host::SimFrame& frame : Chip.sent)
+	{
+		ilmsg::CAN_Message msg = {};
+		msg.id = frame.id;
+		msg.dataSize = frame.dlc;
+		memcpy(msg.data, frame.data, 8);
+
+		ilmsg::MessageType type = ilmsg::GetTypeFromId(msg.id);
+		if (type == ilmsg::MessageType::SetLockState)
+		{
+			ilmsg::MessageSetLockState lock;
+			if (lock.Unpack(msg) && lock.slot < SlotCount)
+			{
+				module[lock.slot].lockState = lock.state;
+				module[lock.slot].locked = lock.locked;
+				module[lock.slot].updates++;
+			}
+		}
+		else if (type == ilmsg::MessageType::SetModuleLockState)
+		{
+			ilmsg::MessageSetModuleLockState lock;
+			if (!lock.Unpack(msg))
+				continue;
+
+			for (int slot = 0; slot < SlotCount; slot++)
+			{
+				if (!lock.HasSlot(slot))
+					continue;
+				module[slot].lockState = lock.GetState(slot);
+				module[slot].locked = lock.IsLocked(slot);
+				module[slot].updates++;
+			}
+		}
+	}
+	Chip.sent.clear();
+}
+
+//! Throw a lever on the module and run one loop of the core
+void Throw(int slot, LeverState position)
+{
+	module[slot].position = position;
+	for (ModuleSlot& s : module)
+		s.updates = 0;
+
+	ilmsg::MessageSetLeverState msg = {};
+	msg.did = ModuleAddress;
+	msg.slot = slot;
+	msg.state = position;
+	ilmsg::CAN_Message frame = {};
+	msg.Pack(frame);
+	Chip.Deliver(frame.id, frame.data, frame.dataSize);
+
+	il.BeginBatch();
+	ilmsg::Processor.ProcessReceived();
+	il.CommitBatch();
+	LeverManager.Tick();
+	ilmsg::Processor.ProcessReceived();
+
+	ReceiveOnModule();
+}
+
+//! Print the state of both levers after a step
+void PrintStep(const char* step)
+{
+	printf("  %-24s", step);
+	for (int slot = 0; slot < SlotCount; slot++)
+	{
+		printf("  %s: %s %s%s%s", levers[slot]->GetName().c_str(),
+			module[slot].position == LeverState::Normal ? "N" : "R",
+			module[slot].lockState == LockState::On ? "on" : "off",
+			module[slot].locked ? " locked" : "",
+			module[slot].ShowsFault() ? " FAULT" : "");
+	}
+	printf("\n");
+}
+
+//! Throw the locked lever B and back with A reversed
+void CheckLockedThrow(const char* mode)
+{
+	printf("%s:\n", mode);
+
+	Throw(0, LeverState::Reversed);
+	PrintStep("A reversed");
+	Check(!module[0].ShowsFault() && module[0].lockState == LockState::Off, "a free lever follows its position");
+	Check(module[1].locked, "reversing A locks B");
+
+	Throw(1, LeverState::Reversed);
+	PrintStep("B reversed while locked");
+	Check(levers[1]->IsFaulted() && levers[1]->GetState() == LockState::On, "the interlocking refuses the locked lever");
+	Check(module[1].lockState == LockState::On && module[1].ShowsFault(), "the module sees the locked lever mismatch");
+	Check(module[1].updates > 0, "the refused move is answered");
+
+	Throw(1, LeverState::Normal);
+	PrintStep("B back to normal");
+	Check(!levers[1]->IsFaulted() && il.GetFaultedCount() == 0, "returning the locked lever clears its fault");
+	Check(!module[1].ShowsFault() && module[1].locked, "the module shows B locked without a fault");
+
+	Throw(0, LeverState::Normal);
+	PrintStep("A back to normal");
+	Check(!module[0].ShowsFault() && !module[1].ShowsFault() && !module[1].locked, "the frame is back at rest");
+}
+
+int main()
+{
+	levers[0] = il.AddLever("A");
+	levers[1] = il.AddLever("B");
+	levers[0]->AddLockRule(LockState::Off, levers[1]->GetId(), ilock::LockedOn);
+	for (ilock::Lever* lever : levers)
+		lever->FinalizeLockRules();
+	il.Compile();
+	il.OnLockChange(LeverLockChanged);
+
+	for (int slot = 0; slot < SlotCount; slot++)
+		LeverManager.RegisterLever(lib::DeviceSlot{ ModuleAddress, (lib::SlotId)slot }, levers[slot]->GetId());
+	LeverManager.OnStateChanged(LeverStateChanged);
+
+	ilmsg::Processor.RegisterDevice(ilmsg::ModuleType::Core, 0);
+	Check(ilmsg::Processor.Start(Chip.csPin, 2, 16E6), "processor starts");
+	LeverManager.Start();
+
+	LeverManager.SetLockSendMode(levercom::LockSendMode::PerSlot);
+	CheckLockedThrow("Per slot lock states");
+	LeverManager.SetLockSendMode(levercom::LockSendMode::PerModule);
+	CheckLockedThrow("Per module lock states");
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,234 @@
+/**
+* LockBoard differential check
+* Author: Kyle Sarnik
+*
+* Runs the same random lever moves and throws through the Locking objects of
+* an interlocking and through a LockBoard built from it, and compares the
+* locked state, state, lever state and fault flag of every lever after each
+* step. Runs on a config file and on a synthetic frame of 255 levers, the
+* most a LockBoard holds. The bench mode times each engine alone.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/lockboard_diff.cpp
+*       libraries/iLock/src/iLock.cpp libraries/iLock/src/LockBoard.cpp
+*       libraries/JSONLoader/src/JSONLoader.cpp -o lockboard_diff
+* Usage:
+*   lockboard_diff [config file] [steps]
+*   lockboard_diff bench [config file] [steps]
+**/
+
+#include "HostFrame.h"
+
+#include <LockBoard.h>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using lib::Vector;
+using ilock::LockBoard;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+
+//! Levers of the synthetic frame and the rules each applies
+constexpr int SyntheticLevers = LockBoard::MaxLockings - 1;
+constexpr int SyntheticRules = 4;
+
+//! Build a frame of random rules, each lever locks 4 random others in a random state
+void BuildSynthetic(ilock::Interlocking& il)
+{
+	std::mt19937 rng(3);
+	Vector<ilock::Lever*> levers;
+	for (int i = 0; i < SyntheticLevers; i++)
+		levers.push_back(il.AddLever(std::to_string(i)));
+
+	const ilock::LockingRule rules[] = { ilock::LockedAny, ilock::LockedOn, ilock::LockedOff };
+	for (int i = 0; i < SyntheticLevers; i++)
+	{
+		for (int k = 0; k < SyntheticRules; k++)
+		{
+			int target = (i + 1 + rng() % (SyntheticLevers - 1)) % SyntheticLevers;
+			LockState state = (rng() & 1) ? LockState::Off : LockState::On;
+			levers[i]->AddLockRule(state, levers[target]->GetId(), rules[rng() % 3]);
+		}
+	}
+
+	for (ilock::Lever* lever : levers)
+		lever->FinalizeLockRules();
+	il.Compile();
+}
+
+//! Random step, a throw or a move to a random state
+struct Step
+{
+	LockingId lid;
+	bool isThrow;
+	LeverState state;
+};
+
+//! Make the random steps, the same for both engines. Played on a board of their own so that a
+//! faulted lever is mostly put back next, otherwise the fault gate would hold the frame locked.
+Vector<Step> MakeSteps(ilock::Interlocking& il, const Vector<LockingId>& levers, long count)
+{
+	LockBoard board;
+	board.Build(il);
+
+	std::mt19937 rng(7);
+	Vector<Step> steps(count);
+	for (Step& step : steps)
+	{
+		step.lid = levers[rng() % levers.size()];
+		step.isThrow = rng() % 3 == 0;
+		step.state = (rng() & 1) ? LeverState::Reversed : LeverState::Normal;
+		if (board.GetFaultedCount() > 0 && rng() % 4 != 0)
+		{
+			size_t i = rng() % levers.size();
+			while (!board.IsFaulted(levers[i]))
+				i = (i + 1) % levers.size();
+			step.lid = levers[i];
+			step.isThrow = false;
+			step.state = board.GetState(step.lid) == LockState::On ? LeverState::Normal : LeverState::Reversed;
+		}
+
+		if (step.isThrow)
+			board.ThrowLever(step.lid);
+		else
+			board.SetLeverState(step.lid, step.state);
+	}
+	return steps;
+}
+
+//! Get the levers of an interlocking
+Vector<LockingId> GetLevers(ilock::Interlocking& il)
+{
+	Vector<LockingId> levers;
+	for (LockingId lid : il.GetAllLockings())
+	{
+		if (il.GetLocking(lid)->IsLever())
+			levers.push_back(lid);
+	}
+	return levers;
+}
+
+//! Run the steps through both engines, returns the number of mismatched levers over all steps
+long Diff(const char* name, ilock::Interlocking& il, long count)
+{
+	LockBoard board;
+	if (!board.Build(il))
+	{
+		fprintf(stderr, "error: %s does not fit a LockBoard\n", name);
+		return -1;
+	}
+
+	Vector<LockingId> levers = GetLevers(il);
+	Vector<Step> steps = MakeSteps(il, levers, count);
+	long mismatches = 0, faultedSteps = 0, lockedSteps = 0;
+	for (const Step& step : steps)
+	{
+		ilock::Lever* lever = static_cast<ilock::Lever*>(il.GetLocking(step.lid));
+		if (step.isThrow)
+		{
+			lever->ThrowLever();
+			board.ThrowLever(step.lid);
+		}
+		else
+		{
+			lever->SetLeverState(step.state);
+			board.SetLeverState(step.lid, step.state);
+		}
+
+		for (LockingId lid : levers)
+		{
+			ilock::Lever* other = static_cast<ilock::Lever*>(il.GetLocking(lid));
+			if (other->IsLocked() != board.IsLocked(lid) || other->GetState() != board.GetState(lid)
+				|| other->GetLeverState() != board.GetLeverState(lid) || other->IsFaulted() != board.IsFaulted(lid))
+				mismatches++;
+		}
+		if (il.GetFaultedCount() != board.GetFaultedCount())
+			mismatches++;
+		if (il.GetFaultedCount() > 0)
+			faultedSteps++;
+		if (lever->IsLocked())
+			lockedSteps++;
+	}
+
+	printf("%s: %d levers, %ld steps, %ld left the lever locked, %ld with a lever faulted, %ld mismatches\n",
+		name, (int)levers.size(), count, lockedSteps, faultedSteps, mismatches);
+	return mismatches;
+}
+
+//! Time the steps through each engine alone
+void Bench(const char* name, ilock::Interlocking& il, long count)
+{
+	LockBoard board;
+	if (!board.Build(il))
+	{
+		fprintf(stderr, "error: %s does not fit a LockBoard\n", name);
+		return;
+	}
+
+	Vector<Step> steps = MakeSteps(il, GetLevers(il), count);
+	typedef std::chrono::steady_clock Clock;
+	volatile int sink = 0;
+
+	auto start = Clock::now();
+	for (const Step& step : steps)
+	{
+		ilock::Lever* lever = static_cast<ilock::Lever*>(il.GetLocking(step.lid));
+		if (step.isThrow)
+			lever->ThrowLever();
+		else
+			lever->SetLeverState(step.state);
+		sink += lever->IsLocked();
+	}
+	double lockingNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+
+	start = Clock::now();
+	for (const Step& step : steps)
+	{
+		if (step.isThrow)
+			board.ThrowLever(step.lid);
+		else
+			board.SetLeverState(step.lid, step.state);
+		sink += board.IsLocked(step.lid);
+	}
+	double boardNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+
+	printf("%s: %ld steps, Locking %.1f ns/step, LockBoard %.1f ns/step\n", name, count, lockingNs, boardNs);
+}
+
+int main(int argc, char** argv)
+{
+	bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+	int arg = bench ? 2 : 1;
+	const char* path = argc > arg ? argv[arg] : "data/config.txt";
+	long count = argc > arg + 1 ? atol(argv[arg + 1]) : (bench ? 3000000 : 1000000);
+	if (count <= 0)
+		count = 1000000;
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	ilock::Interlocking synthetic;
+	BuildSynthetic(synthetic);
+
+	if (bench)
+	{
+		Bench(path, frame.il, count);
+		Bench("synthetic", synthetic, count);
+		return 0;
+	}
+
+	long mismatches = Diff(path, frame.il, count);
+	long syntheticMismatches = Diff("synthetic", synthetic, count);
+	if (mismatches != 0 || syntheticMismatches != 0)
+	{
+		printf("FAILED: LockBoard differs from the Locking objects\n");
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,465 @@
+/**
+* MCP2515 driver checks
+* Author: Kyle Sarnik
+*
+* Runs the CAN library MCP2515 driver, the ilmsg2 controller and message
+* processor on top of it against the simulated chip in HostMcp2515.h, checks
+* every frame arrives intact and in order, counts the SPI transactions each
+* frame costs and checks receive batches stop where configured and message
+* counters match what the bus carried. The receive ring is also run between
+* two threads.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -pthread -DARDUINO=100 -IHostTools/arduino -Ilibraries/CAN/src
+*       -Ilibraries/CommonLib/src -Ilibraries/iLock/src -Ilibraries/InterlockMessage2/src
+*       HostTools/mcp2515_sim.cpp libraries/CAN/src/MCP2515.cpp libraries/CAN/src/CANController.cpp
+*       libraries/InterlockMessage2/src/can_mcp2515.cpp libraries/InterlockMessage2/src/ilmsg2.cpp
+*       libraries/iLock/src/iLock.cpp -o mcp2515_sim
+* Usage:
+*   mcp2515_sim [frames]
+**/
+
+#include "HostMcp2515.h"
+
+#include <CAN.h>
+#include <can_mcp2515.hpp>
+#include <ilmsg2.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using host::Chip;
+
+static int failures = 0;
+
+//! Report a failed check
+void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//! Extended ID and data of frame i, 0 to 8 bytes long
+uint32_t FrameId(int i) { return (uint32_t)(i * 2654435761u) & 0x1fffffff; }
+uint8_t FrameByte(int i, int b) { return (uint8_t)(i * 7 + b); }
+int FrameLength(int i) { return i % 9; }
+
+//! Deliver frames one at a time and read each with parsePacket
+void CheckReceive(int frames)
+{
+	long start = Chip.transactions;
+	bool intact = true;
+	for (int i = 0; i < frames; i++)
+	{
+		uint8_t data[8];
+		for (int b = 0; b < FrameLength(i); b++)
+			data[b] = FrameByte(i, b);
+		Chip.Deliver(FrameId(i), data, FrameLength(i));
+
+		int dlc = CAN.parsePacket();
+		intact &= dlc == FrameLength(i) && CAN.packetExtended() && (uint32_t)CAN.packetId() == FrameId(i);
+		intact &= CAN.available() == FrameLength(i);
+		for (int b = 0; b < FrameLength(i); b++)
+			intact &= CAN.read() == FrameByte(i, b);
+		intact &= Chip.RxFull() == 0;
+	}
+	double perFrame = (double)(Chip.transactions - start) / frames;
+	printf("RX: %d frames, %.2f transactions per frame\n", frames, perFrame);
+	Check(intact, "received frames match the delivered ones and release their buffer");
+	Check(perFrame <= 2.0, "RX takes at most 2 transactions per frame");
+	Check(CAN.parsePacket() == 0, "parsePacket reports nothing when the buffers are empty");
+}
+
+//! Send frames one at a time with the blocking endPacket
+void CheckSend(int frames)
+{
+	Chip.sent.clear();
+	long start = Chip.transactions;
+	bool accepted = true;
+	for (int i = 0; i < frames; i++)
+	{
+		CAN.beginExtendedPacket(FrameId(i), FrameLength(i));
+		for (int b = 0; b < FrameLength(i); b++)
+			CAN.write(FrameByte(i, b));
+		accepted &= CAN.endPacket() == 1;
+	}
+	double perFrame = (double)(Chip.transactions - start) / frames;
+	printf("TX: %d frames, %.2f transactions per frame\n", frames, perFrame);
+
+	bool intact = Chip.sent.size() == (size_t)frames;
+	for (int i = 0; intact && i < frames; i++)
+	{
+		const host::SimFrame& frame = Chip.sent[i];
+		intact &= frame.extended && frame.id == FrameId(i) && frame.dlc == FrameLength(i);
+		for (int b = 0; b < FrameLength(i); b++)
+			intact &= frame.data[b] == FrameByte(i, b);
+	}
+	Check(accepted, "endPacket reports every frame sent");
+	Check(intact, "sent frames match the written ones, in order");
+	Check(perFrame <= 5.0, "TX takes at most 5 transactions per frame");
+}
+
+//! Write frames in bursts of up to 6 through the controller while the bus sends one per poll
+void CheckAsyncSend(can::MCP2515Controller& controller, int frames)
+{
+	Chip.sent.clear();
+	Chip.autoSend = false;
+
+	uint32_t next = 1;
+	long maxWrite = 0;
+	for (int round = 0; next <= (uint32_t)frames; round++)
+	{
+		int burst = round % 5 == 0 ? 6 : 1;
+		for (int i = 0; i < burst; i++)
+		{
+			can::Message msg = {};
+			msg.id = next++;
+			msg.dataSize = 3;
+			msg.data[0] = (uint8_t)msg.id;
+			long start = Chip.transactions;
+			controller.Write(msg);
+			maxWrite = std::max(maxWrite, Chip.transactions - start);
+		}
+		for (int k = 0; k < 2; k++)
+		{
+			Chip.BusTick();
+			controller.Poll();
+		}
+	}
+	for (int k = 0; k < 100; k++)
+	{
+		Chip.BusTick();
+		controller.Poll();
+	}
+
+	bool inOrder = Chip.sent.size() == next - 1;
+	for (size_t i = 0; inOrder && i < Chip.sent.size(); i++)
+		inOrder &= Chip.sent[i].id == i + 1 && Chip.sent[i].data[0] == (uint8_t)(i + 1);
+
+	can::TxStats stats = controller.GetTxStats();
+	printf("Async TX: %u written, %zu on the bus, sent %u, failed %u, dropped %u, queue high water %d, at most %ld transactions per Write\n",
+		next - 1, Chip.sent.size(), stats.sent, stats.failed, stats.dropped, stats.highWater, maxWrite);
+	Check(inOrder, "async frames reach the bus in the order written");
+	Check(stats.sent == next - 1 && stats.failed == 0 && stats.dropped == 0, "every async frame is counted as sent");
+	Check(maxWrite <= 3, "Write takes at most 3 transactions");
+}
+
+//! Write frames nobody acknowledges, they must be aborted and counted as failed
+void CheckAbort(can::MCP2515Controller& controller)
+{
+	can::TxStats before = controller.GetTxStats();
+	Chip.sent.clear();
+	Chip.ack = false;
+
+	for (int i = 0; i < 5; i++)
+	{
+		can::Message msg = {};
+		msg.id = 0x1000 + i;
+		msg.dataSize = 1;
+		controller.Write(msg);
+	}
+	for (int k = 0; k < 10; k++)
+	{
+		host::Advance(60);
+		Chip.BusTick();
+		controller.Poll();
+	}
+
+	can::TxStats stats = controller.GetTxStats();
+	printf("No ack: sent %u, failed %u, buffers free %d\n", stats.sent - before.sent, stats.failed - before.failed, controller.TxReady());
+	Check(Chip.sent.empty() && stats.sent == before.sent, "nothing is sent without an acknowledgement");
+	Check(stats.failed - before.failed == 5, "all 5 unacknowledged frames are aborted and counted as failed");
+	Check(controller.TxReady(), "the buffers free up after the aborts");
+
+	Chip.ack = true;
+}
+
+//! Interrupt the controller for each delivered frame, including one with a DLC of 15
+void CheckInterruptReceive(can::MCP2515Controller& controller)
+{
+	const int irq = digitalPinToInterrupt(2);
+	uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	// A DLC above 8 still carries 8 data bytes, the rest of the message must stay intact
+	Chip.Deliver(0x1234567, data, 15);
+	host::FireInterrupt(irq);
+	can::Message msg;
+	msg.dataSize = -1;
+	bool read = controller.Read(msg);
+	bool intact = read && msg.id == 0x1234567 && msg.dataSize == 8 && memcmp(msg.data, data, 8) == 0;
+	printf("DLC 15: read %d, id %x, data size %d\n", read, (unsigned)msg.id, msg.dataSize);
+	Check(intact, "a frame with DLC 15 is read as 8 data bytes");
+
+	// More frames than the ring holds while the loop is busy
+	const int frames = can::RxRingSize + 8;
+	for (int i = 0; i < frames; i++)
+	{
+		data[0] = (uint8_t)i;
+		Chip.Deliver(0x100 + i, data, 1 + i % 8);
+		host::FireInterrupt(irq);
+	}
+
+	can::RxStats stats = controller.GetRxStats();
+	int pending = controller.Pending();
+	bool inOrder = true;
+	int received = 0;
+	while (controller.Read(msg))
+	{
+		inOrder &= msg.id == (can::IdType)(0x100 + received) && msg.data[0] == received && msg.dataSize == 1 + received % 8;
+		received++;
+	}
+	printf("Interrupt RX: %d frames into a %d frame ring, %d pending, %u overflows, high water %d, %d read\n",
+		frames, stats.capacity, pending, stats.overflows, stats.highWater, received);
+	Check(Chip.RxFull() == 0 && Chip.rxLost == 0, "the interrupt drains the hardware buffers");
+	Check(pending == can::RxRingSize && received == can::RxRingSize && inOrder, "the ring keeps the first frames in order");
+	Check(stats.overflows == (uint32_t)(frames - can::RxRingSize) && stats.highWater == can::RxRingSize, "frames pushed to a full ring are counted");
+}
+
+//! Push items through the ring between two threads, every item must arrive once and in order
+void CheckRingThreads(uint32_t items)
+{
+	static lib::SpscRing<uint32_t, 32> ring;
+	std::thread producer([items]() {
+		for (uint32_t i = 0; i < items; i++)
+		{
+			while (!ring.Push(i))
+				std::this_thread::yield();
+		}
+	});
+
+	uint32_t expected = 0;
+	bool inOrder = true;
+	while (expected < items)
+	{
+		uint32_t item;
+		if (!ring.Pop(item))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		inOrder &= item == expected;
+		expected++;
+	}
+	producer.join();
+
+	printf("Ring threads: %u items, in order %d\n", items, inOrder);
+	Check(inOrder && ring.Size() == 0, "items cross the ring between threads in order");
+}
+
+//! Each heartbeat handled takes a millisecond, so the receive budget can run out
+void OnHeartbeat(const ilmsg::MessageHeartbeat& msg)
+{
+	host::nowMicros += 1000;
+}
+
+//! Deliver heartbeats from count devices, firing the interrupt after each when given
+void DeliverHeartbeats(int count, int irq)
+{
+	for (int i = 0; i < count; i++)
+	{
+		ilmsg::MessageHeartbeat heartbeat = {};
+		heartbeat.did = (ilmsg::DeviceId)(i + 1);
+		ilmsg::CAN_Message msg = {};
+		heartbeat.PackMessage(msg);
+		Chip.Deliver(msg.id, msg.data, msg.dataSize);
+		if (irq >= 0)
+			host::FireInterrupt(irq);
+	}
+}
+
+//! Check one ProcessReceived call, returns false if it did not match
+bool CheckBatch(ilmsg::MessageProcessor& processor, int processed, int pending)
+{
+	ilmsg::ReceiveResult result = processor.ProcessReceived();
+	printf(" %d/%d", result.processed, result.pending);
+	return result.processed == processed && result.pending == pending;
+}
+
+//! Process queued messages in batches limited by count, by time and by the hardware buffers
+void CheckBatchReceive()
+{
+	ilmsg::MessageProcessor processor;
+	processor.SetReceiveMode(can::ReceiveMode::Interrupt);
+	processor.OnMessage(OnHeartbeat);
+	Check(processor.Start(Chip.csPin, 2, 16E6), "processor starts");
+	const int irq = digitalPinToInterrupt(2);
+
+	// 20 queued, batches of 8
+	printf("Batches of 8 from 20 queued, processed/pending:");
+	DeliverHeartbeats(20, irq);
+	processor.SetReceiveBatch(8);
+	bool counted = CheckBatch(processor, 8, 12);
+	counted &= CheckBatch(processor, 8, 4);
+	counted &= CheckBatch(processor, 4, 0);
+	counted &= CheckBatch(processor, 0, 0);
+	printf("\n");
+	Check(counted, "batches stop at the batch size and report what is left");
+
+	// Each message takes 1 ms, a 2.5 ms budget ends the batch after 3
+	printf("Budget of 2.5 ms from 10 queued, processed/pending:");
+	DeliverHeartbeats(10, irq);
+	processor.SetReceiveBatch(32, 2500);
+	bool budgeted = CheckBatch(processor, 3, 7);
+	processor.SetReceiveBatch(32, 1);
+	budgeted &= CheckBatch(processor, 1, 6);
+	processor.SetReceiveBatch(32);
+	budgeted &= CheckBatch(processor, 6, 0);
+	printf("\n");
+	Check(budgeted, "the time budget ends a batch, and a batch always processes one message");
+
+	ilmsg::MessageProcessor polled;
+	polled.OnMessage(OnHeartbeat);
+	Check(polled.Start(Chip.csPin, 2, 16E6), "polled processor starts");
+
+	// Without the interrupt only the two hardware buffers are counted
+	printf("Poll mode, batches of 1 from both hardware buffers, processed/pending:");
+	DeliverHeartbeats(2, -1);
+	polled.SetReceiveBatch(1);
+	bool polledCounted = CheckBatch(polled, 1, 1);
+	polledCounted &= CheckBatch(polled, 1, 0);
+	polledCounted &= CheckBatch(polled, 0, 0);
+	printf("\n");
+	Check(polledCounted, "poll mode reports the full hardware buffers as pending");
+}
+
+//! Deliver a packed message and fire the interrupt, with its size or version byte changed when given
+template <class T>
+void DeliverMessage(const T& message, int dataSize = -1, int version = -1)
+{
+	ilmsg::CAN_Message msg = {};
+	message.PackMessage(msg);
+	if (dataSize >= 0)
+		msg.dataSize = dataSize;
+	if (version >= 0)
+		msg.data[0] = (byte)version;
+	Chip.Deliver(msg.id, msg.data, msg.dataSize);
+	host::FireInterrupt(digitalPinToInterrupt(2));
+}
+
+//! Sum of the counters of every message type
+uint32_t CountAll(const uint32_t* counts)
+{
+	uint32_t total = 0;
+	for (int i = 0; i < (int)ilmsg::MessageType::NMessageType; i++)
+		total += counts[i];
+	return total;
+}
+
+//! Count sent messages once they reach the controller and received ones once they unpack
+void CheckMessageStats()
+{
+	ilmsg::MessageProcessor processor;
+	processor.SetReceiveMode(can::ReceiveMode::Interrupt);
+	processor.OnMessage(OnHeartbeat);
+	Check(processor.Start(Chip.csPin, 2, 16E6), "stats processor starts");
+	Chip.sent.clear();
+	Chip.autoSend = false;
+
+	// 3 heartbeats take the hardware buffers, then the lock state of one slot is replaced 4 times
+	// in the queue and heartbeats of other devices offer one message too many to the full queue
+	ilmsg::MessageHeartbeat heartbeat = {};
+	ilmsg::MessageSetLockState lock = {};
+	lock.slot = 1;
+	int offered = 0;
+	for (int i = 0; i < 3; i++, offered++)
+	{
+		heartbeat.did = (ilmsg::DeviceId)i;
+		processor.SendMessage(heartbeat);
+	}
+	for (int i = 0; i < 5; i++, offered++)
+		processor.SendMessage(lock);
+	for (int i = 0; i < ilmsg::SendQueueSize; i++, offered++)
+	{
+		heartbeat.did = (ilmsg::DeviceId)(3 + i);
+		processor.SendMessage(heartbeat);
+	}
+
+	const ilmsg::MessageStats& stats = processor.GetMessageStats();
+	uint32_t queuedTx = CountAll(stats.tx);
+	for (int k = 0; k < 100; k++)
+	{
+		Chip.BusTick();
+		processor.ProcessReceived();
+	}
+	Chip.autoSend = true;
+
+	ilmsg::SendQueueStats queue = processor.GetSendQueueStats();
+	uint32_t bus[(int)ilmsg::MessageType::NMessageType] = {};
+	for (const host::SimFrame& frame : Chip.sent)
+		bus[(int)ilmsg::GetTypeFromId(frame.id)]++;
+	bool sameTypes = memcmp(bus, stats.tx, sizeof(bus)) == 0;
+
+	printf("Message TX: %d offered, %u replaced, %u dropped, %u counted before the bus ran, %u counted, %zu on the bus\n",
+		offered, queue.replaced, queue.dropped, queuedTx, CountAll(stats.tx), Chip.sent.size());
+	Check(queuedTx == 3, "messages waiting in the queue are not counted as sent");
+	Check(CountAll(stats.tx) == offered - queue.replaced - queue.dropped && sameTypes,
+		"tx counts each message the bus carried, and no replaced or dropped one");
+
+	// 3 heartbeats handled, 2 lock states nobody handles, one frame of each with a bad version or size
+	processor.ResetMessageStats();
+	for (int i = 0; i < 3; i++)
+		DeliverMessage(heartbeat);
+	DeliverMessage(heartbeat, -1, ilmsg::SchemaVersion + 1);
+	for (int i = 0; i < 2; i++)
+		DeliverMessage(lock);
+	DeliverMessage(lock, 1);
+	int delivered = 7;
+	processor.SetReceiveBatch(32);
+	processor.ProcessReceived();
+
+	uint32_t rx = CountAll(stats.rx);
+	printf("Message RX: %d delivered, %u heartbeats, %u lock states, %u invalid\n", delivered,
+		stats.rx[(int)ilmsg::MessageType::Heartbeat], stats.rx[(int)ilmsg::MessageType::SetLockState], stats.rxInvalid);
+	Check(stats.rx[(int)ilmsg::MessageType::Heartbeat] == 3 && stats.rx[(int)ilmsg::MessageType::SetLockState] == 2,
+		"rx counts the frames of each type which unpack, handled or not");
+	Check(stats.rxInvalid == 2 && rx + stats.rxInvalid == (uint32_t)delivered, "a frame counts in rx or rxInvalid, never both");
+}
+
+int main(int argc, char** argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 1000;
+	if (frames <= 0)
+		frames = 1000;
+
+	CAN.setPins(Chip.csPin, 2);
+	Check(CAN.begin(500E3) == 1, "begin finds the chip");
+
+	CheckReceive(frames);
+	CheckSend(frames);
+
+	can::MCP2515Controller controller;
+	can::Filter filter = { 0, 0 };
+	controller.SetPins(Chip.csPin, 2);
+	controller.SetClockSpeed(16E6);
+	controller.SetFilter(filter);
+	Check(controller.Start(), "controller starts");
+
+	CheckAsyncSend(controller, frames * 4);
+	CheckAbort(controller);
+
+	can::MCP2515Controller interruptController;
+	interruptController.SetPins(Chip.csPin, 2);
+	interruptController.SetClockSpeed(16E6);
+	interruptController.SetFilter(filter);
+	interruptController.SetReceiveMode(can::ReceiveMode::Interrupt);
+	Check(interruptController.Start(), "interrupt controller starts");
+
+	CheckInterruptReceive(interruptController);
+	CheckRingThreads(frames * 200);
+
+	CheckBatchReceive();
+	CheckMessageStats();
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,239 @@
+/**
+* Message codec fuzzer
+* Author: Kyle Sarnik
+*
+* Packs random field values for every message in the ilmsg2 schema, unpacks
+* them again and checks the fields and the repacked frame match. Random
+* frames are checked to be accepted only with the message size and the
+* current SchemaVersion. The bench mode times Pack and Unpack of each message.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DARDUINO=100 -IHostTools/arduino -Ilibraries/CAN/src
+*       -Ilibraries/CommonLib/src -Ilibraries/iLock/src -Ilibraries/InterlockMessage2/src
+*       HostTools/msgcodec_fuzz.cpp libraries/CAN/src/MCP2515.cpp libraries/CAN/src/CANController.cpp
+*       libraries/InterlockMessage2/src/can_mcp2515.cpp libraries/InterlockMessage2/src/ilmsg2.cpp
+*       libraries/iLock/src/iLock.cpp -o msgcodec_fuzz
+* Usage:
+*   msgcodec_fuzz [iterations per message] [seed]
+*   msgcodec_fuzz bench [iterations]
+**/
+
+#include <ilmsg2.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace ilmsg;
+
+static std::mt19937 rng;
+static int failures = 0;
+
+//! Random value of the given width
+uint32_t RandomBits(int bits)
+{
+	uint32_t value = rng();
+	return bits >= 32 ? value : value & ((1u << bits) - 1);
+}
+
+//! Report a failed check, with the message it failed on
+void Check(bool condition, const char* message, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s: %s\n", message, what);
+		failures++;
+	}
+}
+
+#define FUZZ_RANDOMIZE(name, type, bits) \
+	msg.name = (type)RandomBits(bits);
+
+#define FUZZ_COMPARE(name, type, bits) \
+	same &= (uint32_t)a.name == (uint32_t)b.name;
+
+//! Field access of each message, generated from the schema
+#define FUZZ_FIELDS(msgname, module) \
+	struct Fields##msgname \
+	{ \
+		typedef Message##msgname Message; \
+		static void Randomize(Message& msg) \
+		{ \
+			(void)msg; \
+			ILMSG_FIELDS_##msgname(FUZZ_RANDOMIZE) \
+		} \
+		static bool Equal(const Message& a, const Message& b) \
+		{ \
+			bool same = true; \
+			(void)a; \
+			(void)b; \
+			ILMSG_FIELDS_##msgname(FUZZ_COMPARE) \
+			return same; \
+		} \
+	};
+
+ILMSG_MESSAGES(FUZZ_FIELDS)
+
+//! Get whether two frames have the same ID and payload
+bool SameFrame(const CAN_Message& a, const CAN_Message& b)
+{
+	return a.id == b.id && a.dataSize == b.dataSize && memcmp(a.data, b.data, a.dataSize) == 0;
+}
+
+//! Pack random messages, unpack and repack them
+template <class F>
+void CheckRoundTrip(const char* name, int iterations)
+{
+	typedef typename F::Message T;
+	bool packed = true, unpacked = true, repacked = true, rejected = true;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		T msg;
+		F::Randomize(msg);
+		DeviceId dest = (DeviceId)RandomBits(8);
+		msg.SetDestination(dest);
+
+		CAN_Message frame = {};
+		msg.Pack(frame);
+		packed &= frame.dataSize == T::DataSize && frame.data[0] == SchemaVersion && GetTypeFromId(frame.id) == T::Type;
+
+		T copy;
+		unpacked &= copy.Unpack(frame) && F::Equal(msg, copy);
+
+		CAN_Message again = {};
+		copy.SetDestination(dest);
+		copy.Pack(again);
+		repacked &= SameFrame(frame, again);
+
+		// Any other version or size is refused
+		CAN_Message bad = frame;
+		bad.data[0] = (byte)(SchemaVersion + 1 + RandomBits(8) % 255);
+		rejected &= !copy.Unpack(bad);
+		bad = frame;
+		bad.dataSize = (T::DataSize + 1 + (int)RandomBits(3)) % 9;
+		rejected &= bad.dataSize == T::DataSize || !copy.Unpack(bad);
+	}
+
+	Check(packed, name, "packed frame carries the size, version and type");
+	Check(unpacked, name, "unpacked fields match the packed ones");
+	Check(repacked, name, "repacked frame matches bit for bit");
+	Check(rejected, name, "frames with another version or size are refused");
+}
+
+//! Unpack random frames, only frames of the message size and current version may be accepted
+template <class F>
+void CheckRandomFrames(const char* name, int iterations)
+{
+	typedef typename F::Message T;
+	bool gated = true, repacked = true;
+	int accepted = 0;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		CAN_Message frame = {};
+		frame.id = (CAN_IdType)T::Type;
+		frame.dataSize = (rng() & 1) ? T::DataSize : (int)(RandomBits(8) % 9);
+		for (int b = 0; b < 8; b++)
+			frame.data[b] = (byte)RandomBits(8);
+		if (rng() & 1)
+			frame.data[0] = SchemaVersion;
+
+		T msg;
+		bool expect = frame.dataSize == T::DataSize && frame.data[0] == SchemaVersion;
+		bool ok = msg.Unpack(frame);
+		gated &= ok == expect;
+		if (!ok)
+			continue;
+		accepted++;
+
+		// Bits past the last field are not carried
+		CAN_Message again = {};
+		msg.Pack(again);
+		for (int b = 1; b < T::DataSize; b++)
+		{
+			int used = T::PayloadBits - (b - 1) * 8;
+			byte mask = used >= 8 ? 0xFF : (byte)((1 << used) - 1);
+			repacked &= again.data[b] == (frame.data[b] & mask);
+		}
+	}
+
+	printf("%-20s %d random frames, %d accepted\n", name, iterations, accepted);
+	Check(gated, name, "random frames are accepted only with the message size and version");
+	Check(repacked, name, "accepted random frames repack to the same payload bits");
+}
+
+//! Time Pack and Unpack of a message over random field values
+template <class F>
+void Bench(const char* name, int iterations)
+{
+	typedef typename F::Message T;
+	const int Samples = 1024;
+	static T msgs[Samples];
+	static CAN_Message frames[Samples];
+	for (int i = 0; i < Samples; i++)
+	{
+		F::Randomize(msgs[i]);
+		msgs[i].Pack(frames[i]);
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	volatile uint32_t sink = 0;
+
+	auto start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		CAN_Message frame;
+		msgs[i & (Samples - 1)].Pack(frame);
+		sink += frame.data[T::DataSize - 1];
+	}
+	double packNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		T msg;
+		sink += msg.Unpack(frames[i & (Samples - 1)]);
+	}
+	double unpackNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	printf("%-20s %d bytes  pack %6.2f ns  unpack %6.2f ns\n", name, T::DataSize, packNs, unpackNs);
+}
+
+#define FUZZ_RUN(msgname, module) \
+	CheckRoundTrip<Fields##msgname>(#msgname, iterations); \
+	CheckRandomFrames<Fields##msgname>(#msgname, iterations);
+
+#define FUZZ_BENCH(msgname, module) \
+	Bench<Fields##msgname>(#msgname, iterations);
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+	{
+		int iterations = argc > 2 ? atoi(argv[2]) : 10000000;
+		if (iterations <= 0)
+			iterations = 10000000;
+		ILMSG_MESSAGES(FUZZ_BENCH)
+		return 0;
+	}
+
+	int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+	if (iterations <= 0)
+		iterations = 200000;
+	unsigned seed = argc > 2 ? (unsigned)strtoul(argv[2], nullptr, 10) : 1;
+	rng.seed(seed);
+
+	printf("Schema version %d, %d messages, seed %u\n", SchemaVersion, (int)MessageType::NMessageType, seed);
+	ILMSG_MESSAGES(FUZZ_RUN)
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,204 @@
+/**
+* Route planner checks
+* Author: Kyle Sarnik
+*
+* Adds a route for each lever reversed and for random sets of 2 to 3 lever
+* states, those which can be set from rest, then walks the frame through
+* random permitted moves. From each partly set state every route is planned
+* with PlanRoute, which may take the cached plan, and with Plan, which always
+* searches. The plans must have the same length and each must set the route
+* when played on the interlocking.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/route_check.cpp
+*       libraries/iLock/src/iLock.cpp libraries/iLock/src/LockBoard.cpp libraries/iLock/src/RoutePlanner.cpp
+*       libraries/JSONLoader/src/JSONLoader.cpp -o route_check
+* Usage:
+*   route_check [config file] [states]
+**/
+
+#include "HostFrame.h"
+
+#include <RoutePlanner.h>
+
+#include <random>
+
+using lib::String;
+using lib::Vector;
+using ilock::LeverMove;
+using ilock::LockingId;
+using ilock::LockState;
+using ilock::RoutePlanner;
+using LeverState = ilock::Lever::State;
+
+static int failures = 0;
+
+//! Report a failed check
+void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//! Print a plan for a failed check
+void PrintPlan(host::Frame& frame, const char* label, const LeverMove* plan, int length)
+{
+	printf("  %s:", label);
+	for (int i = 0; i < length; i++)
+	{
+		printf(" %s:%s", frame.il.GetLocking(plan[i].lid)->GetName().c_str(),
+			plan[i].state == LeverState::Reversed ? "R" : "N");
+	}
+	printf(" (%d moves)\n", length);
+}
+
+//! Print the levers not normal in the live state
+void PrintState(host::Frame& frame)
+{
+	printf("  from:");
+	for (LockingId lid : frame.il.GetAllLockings())
+	{
+		if (frame.il.GetLocking(lid)->GetState() == LockState::Off)
+			printf(" %s:R", frame.il.GetLocking(lid)->GetName().c_str());
+	}
+	printf("\n");
+}
+
+//! Get whether the plan can be played on the interlocking and sets the route, the live state is restored after
+bool PlaysOut(host::Frame& frame, const LeverMove* plan, int length, const ilock::Route& route)
+{
+	ilock::Interlocking& il = frame.il;
+	Vector<LockState> saved;
+	for (LockingId lid : il.GetAllLockings())
+		saved.push_back(il.GetLocking(lid)->GetState());
+
+	bool ok = true;
+	for (int i = 0; i < length && ok; i++)
+	{
+		ilock::Lever* lever = static_cast<ilock::Lever*>(il.GetLocking(plan[i].lid));
+		ok = !lever->IsLocked();
+		lever->SetLeverState(plan[i].state);
+	}
+	for (const LeverMove& move : route.levers)
+		ok &= (il.GetLocking(move.lid)->GetState() == LockState::Off) == (move.state == LeverState::Reversed);
+
+	// Undo in reverse, every move of a valid plan can be taken back
+	for (int i = length - 1; i >= 0; i--)
+	{
+		ilock::Lever* lever = static_cast<ilock::Lever*>(il.GetLocking(plan[i].lid));
+		lever->SetLeverState(plan[i].state == LeverState::Reversed ? LeverState::Normal : LeverState::Reversed);
+	}
+	Vector<LockingId> ids = il.GetAllLockings();
+	for (size_t i = 0; i < ids.size(); i++)
+		ok &= il.GetLocking(ids[i])->GetState() == saved[i];
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	long count = argc > 2 ? atol(argv[2]) : 200;
+	if (count <= 0)
+		count = 200;
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	Vector<LockingId> levers;
+	for (LockingId lid : frame.il.GetAllLockings())
+	{
+		if (frame.il.GetLocking(lid)->IsLever())
+			levers.push_back(lid);
+	}
+
+	// Routes which cannot be set from rest are left out, searching for them only runs to the limit
+	RoutePlanner planner;
+	planner.Build(frame.il);
+	planner.SetSearchLimit(20000);
+	std::mt19937 rng(11);
+	Vector<String> names;
+	Vector<Vector<LeverMove>> routes;
+	for (LockingId lid : levers)
+	{
+		names.push_back(frame.il.GetLocking(lid)->GetName());
+		routes.push_back({ LeverMove{ lid, LeverState::Reversed } });
+	}
+	for (int r = 0; r < 40; r++)
+	{
+		Vector<LeverMove> moves;
+		int n = 2 + rng() % 2;
+		for (int i = 0; i < n; i++)
+			moves.push_back(LeverMove{ levers[(r * 3 + i * 5) % levers.size()], (rng() & 1) ? LeverState::Reversed : LeverState::Normal });
+		names.push_back("set " + std::to_string(r));
+		routes.push_back(moves);
+	}
+
+	RoutePlanner check;
+	check.Build(frame.il);
+	for (size_t r = 0; r < routes.size(); r++)
+	{
+		int route = check.AddRoute(names[r], routes[r].data(), (int)routes[r].size());
+		if (check.GetRoute(route).reachable)
+			planner.AddRoute(names[r], routes[r].data(), (int)routes[r].size());
+	}
+
+	long plans = 0, cachedShorter = 0, unplanned = 0;
+	bool sameLength = true, valid = true;
+	for (long s = 0; s < count; s++)
+	{
+		// A few random permitted moves from the last state
+		for (int m = 0; m < 3; m++)
+		{
+			ilock::Lever* lever = static_cast<ilock::Lever*>(frame.il.GetLocking(levers[rng() % levers.size()]));
+			if (!lever->IsLocked())
+				lever->SetLeverState(lever->GetLeverState() == LeverState::Normal ? LeverState::Reversed : LeverState::Normal);
+		}
+
+		for (int r = 0; r < planner.GetRouteCount(); r++)
+		{
+			const ilock::Route& route = planner.GetRoute(r);
+			LeverMove cached[RoutePlanner::MaxPlanLength], searched[RoutePlanner::MaxPlanLength];
+			int cachedLength = planner.PlanRoute(r, frame.il, cached, RoutePlanner::MaxPlanLength);
+			int searchedLength = planner.Plan(route.levers.data(), (int)route.levers.size(), frame.il, searched, RoutePlanner::MaxPlanLength);
+			plans++;
+			if (searchedLength < 0)
+			{
+				unplanned++;
+				continue;
+			}
+
+			if (cachedLength != searchedLength)
+			{
+				if (sameLength)
+				{
+					printf("route %s:\n", route.name.c_str());
+					PrintState(frame);
+					PrintPlan(frame, "PlanRoute", cached, cachedLength);
+					PrintPlan(frame, "Plan", searched, searchedLength);
+				}
+				sameLength = false;
+				cachedShorter += cachedLength < searchedLength;
+			}
+			valid &= PlaysOut(frame, cached, cachedLength, route) && PlaysOut(frame, searched, searchedLength, route);
+		}
+	}
+
+	printf("%s: %d routes, %ld states, %ld plans, %ld without a plan\n",
+		path, planner.GetRouteCount(), count, plans, unplanned);
+	Check(sameLength, "PlanRoute plans are as short as Plan from every state");
+	Check(cachedShorter == 0, "PlanRoute is never shorter than the search");
+	Check(valid, "every plan can be played and sets its route");
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,112 @@
+/**
+* Interlocking route planner
+* Author: Kyle Sarnik
+*
+* Plans the configured routes of a frame from the rest state and prints the
+* lever moves, or plans the lever states given on the command line.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/routes.cpp
+*       libraries/iLock/src/iLock.cpp libraries/iLock/src/LockBoard.cpp libraries/iLock/src/RoutePlanner.cpp
+*       libraries/JSONLoader/src/JSONLoader.cpp -o routes
+* Usage:
+*   routes [config file] [<lever>:<N|R> ...]
+**/
+
+#include "HostFrame.h"
+
+#include <RoutePlanner.h>
+
+using lib::String;
+using lib::Vector;
+using ilock::LeverMove;
+using ilock::RoutePlanner;
+using LeverState = ilock::Lever::State;
+
+//! Print a plan, length is -1 when there is none
+void PrintPlan(host::Frame& frame, const char* route, const LeverMove* plan, int length)
+{
+	printf("%s: ", route);
+	if (length < 0)
+	{
+		printf("NO PLAN\n");
+		return;
+	}
+	for (int i = 0; i < length; i++)
+	{
+		printf("%s:%s ", frame.il.GetLocking(plan[i].lid)->GetName().c_str(),
+			plan[i].state == LeverState::Reversed ? "R" : "N");
+	}
+	printf("(%d moves)\n", length);
+}
+
+//! Find a lever by name and add it to the moves, returns false if not found
+bool AddLever(host::Frame& frame, const String& name, LeverState state, Vector<LeverMove>& levers)
+{
+	ilock::Locking* lever = frame.il.GetLocking(name);
+	if (!lever)
+	{
+		fprintf(stderr, "error: locking \"%s\" not found\n", name.c_str());
+		return false;
+	}
+	levers.push_back(LeverMove{ lever->GetId(), state });
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	RoutePlanner planner;
+	planner.Build(frame.il);
+
+	// Configured routes, planned from rest when added
+	for (auto& data : frame.routes)
+	{
+		Vector<LeverMove> levers;
+		for (auto& name : data.reversed)
+			AddLever(frame, name, LeverState::Reversed, levers);
+		for (auto& name : data.normal)
+			AddLever(frame, name, LeverState::Normal, levers);
+
+		int route = planner.AddRoute(data.name, levers.data(), (int)levers.size());
+		const ilock::Route& planned = planner.GetRoute(route);
+		PrintPlan(frame, data.name.c_str(), planned.plan.data(), planned.reachable ? (int)planned.plan.size() : -1);
+	}
+
+	// Lever states from the command line
+	if (argc > 2)
+	{
+		Vector<LeverMove> levers;
+		String request;
+		for (int i = 2; i < argc; i++)
+		{
+			String token = argv[i];
+			size_t split = token.find(':');
+			if (split == String::npos)
+			{
+				fprintf(stderr, "error: expected <lever>:<N|R>, got %s\n", argv[i]);
+				return 1;
+			}
+			LeverState state = token.back() == 'R' ? LeverState::Reversed : LeverState::Normal;
+			if (!AddLever(frame, token.substr(0, split), state, levers))
+				return 1;
+			request += token + " ";
+		}
+
+		LeverMove plan[RoutePlanner::MaxPlanLength];
+		int length = planner.Plan(levers.data(), (int)levers.size(), frame.il, plan, RoutePlanner::MaxPlanLength);
+		PrintPlan(frame, request.c_str(), plan, length);
+	}
+	else if (frame.routes.empty())
+	{
+		printf("No routes configured, pass lever states as <lever>:<N|R> to plan them\n");
+	}
+
+	return 0;
+}
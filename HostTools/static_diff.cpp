@@ -0,0 +1,169 @@
+/**
+* StaticInterlocking differential check
+* Author: Kyle Sarnik
+*
+* Runs the same random lever moves, throws and module faults through an
+* Interlocking loaded from a config file and through the StaticInterlocking
+* of the tables in InterlockingCore/ilconfig.h, half of them in batches.
+* After each group of moves it compares the locked state, state, lever state
+* and fault flag of every lever and the lock change callbacks of both.
+* The config file must be the one the tables were generated from.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/static_diff.cpp
+*       libraries/iLock/src/iLock.cpp libraries/JSONLoader/src/JSONLoader.cpp -o static_diff
+* Usage:
+*   static_diff [config file] [groups]
+**/
+
+#include "HostFrame.h"
+#include "../InterlockingCore/ilconfig.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <utility>
+
+using lib::Vector;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+
+typedef std::pair<LockingId, bool> LockChangeCall;
+
+ilock::StaticInterlocking<ilconfig::LeverCount> staticIl(ilconfig::Levers, ilconfig::Rules, ilconfig::RuleOffsets);
+Vector<LockChangeCall> dynamicCalls, staticCalls;
+
+void DynamicLockChanged(LockingId lid, bool locked)
+{
+	dynamicCalls.push_back({ lid, locked });
+}
+
+void StaticLockChanged(LockingId lid, bool locked)
+{
+	staticCalls.push_back({ lid, locked });
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	long count = argc > 2 ? atol(argv[2]) : 1000000;
+	if (count <= 0)
+		count = 1000000;
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	// Lever n of the table must be the lever the interlocking gave ID n + 1
+	bool sameLevers = (int)frame.levers.size() == ilconfig::LeverCount;
+	for (int i = 0; sameLevers && i < ilconfig::LeverCount; i++)
+	{
+		ilock::Locking* lever = frame.il.GetLocking((LockingId)(i + 1));
+		sameLevers = lever && strcmp(lever->GetName().c_str(), ilconfig::Levers[i].name) == 0;
+	}
+	if (!sameLevers)
+	{
+		fprintf(stderr, "error: ilconfig.h was not generated from %s, run tablegen first\n", path);
+		return 1;
+	}
+
+	frame.il.OnLockChange(DynamicLockChanged);
+	staticIl.Init();
+	staticIl.OnLockChange(StaticLockChanged);
+
+	std::mt19937 rng(9);
+	long steps = 0, mismatches = 0, callMismatches = 0, calls = 0, faultedGroups = 0;
+	for (long g = 0; g < count; g++)
+	{
+		dynamicCalls.clear();
+		staticCalls.clear();
+
+		// 1 to 5 steps, in a batch half the time
+		int groupSteps = 1 + rng() % 5;
+		bool batch = rng() & 1;
+		if (batch)
+		{
+			frame.il.BeginBatch();
+			staticIl.BeginBatch();
+		}
+		for (int s = 0; s < groupSteps; s++, steps++)
+		{
+			LockingId lid = (LockingId)(1 + rng() % ilconfig::LeverCount);
+			int op = rng() % 16;
+			LeverState state = (rng() & 1) ? LeverState::Reversed : LeverState::Normal;
+
+			// Put a faulted lever back half the time, otherwise the fault gate holds every lever locked
+			if (staticIl.GetFaultedCount() > 0 && (rng() & 1))
+			{
+				for (int i = 1; i <= ilconfig::LeverCount; i++)
+				{
+					if (staticIl.IsFaulted((LockingId)i))
+					{
+						lid = (LockingId)i;
+						op = 15;
+						state = staticIl.GetState(lid) == LockState::On ? LeverState::Normal : LeverState::Reversed;
+						break;
+					}
+				}
+			}
+
+			ilock::Lever* lever = static_cast<ilock::Lever*>(frame.il.GetLocking(lid));
+			if (op < 5)
+			{
+				lever->ThrowLever();
+				staticIl.ThrowLever(lid);
+			}
+			else if (op == 5)
+			{
+				// A module lost or found, as the core marks its levers
+				bool faulted = rng() & 1;
+				frame.il.SetLeverFaulted(lid, faulted);
+				staticIl.SetLeverFaulted(lid, faulted);
+			}
+			else
+			{
+				lever->SetLeverState(state);
+				staticIl.SetLeverState(lid, state);
+			}
+		}
+		if (batch)
+		{
+			frame.il.CommitBatch();
+			staticIl.CommitBatch();
+		}
+
+		for (int i = 1; i <= ilconfig::LeverCount; i++)
+		{
+			LockingId lid = (LockingId)i;
+			ilock::Lever* lever = static_cast<ilock::Lever*>(frame.il.GetLocking(lid));
+			if (lever->IsLocked() != staticIl.IsLocked(lid) || lever->GetState() != staticIl.GetState(lid)
+				|| lever->GetLeverState() != staticIl.GetLeverState(lid) || frame.il.IsLeverFaulted(lid) != staticIl.IsFaulted(lid))
+				mismatches++;
+		}
+		if (frame.il.GetFaultedCount() != staticIl.GetFaultedCount())
+			mismatches++;
+		if (staticIl.GetFaultedCount() > 0)
+			faultedGroups++;
+
+		// Callbacks of one change may come in another order, compare them sorted
+		std::sort(dynamicCalls.begin(), dynamicCalls.end());
+		std::sort(staticCalls.begin(), staticCalls.end());
+		if (dynamicCalls != staticCalls)
+			callMismatches++;
+		calls += dynamicCalls.size();
+	}
+
+	printf("%s: %d levers, %ld groups, %ld steps, %ld groups with a lever faulted\n",
+		path, ilconfig::LeverCount, count, steps, faultedGroups);
+	printf("%ld lock change callbacks, %ld state mismatches, %ld groups with other callbacks\n",
+		calls, mismatches, callMismatches);
+	if (mismatches != 0 || callMismatches != 0)
+	{
+		printf("FAILED: StaticInterlocking differs from Interlocking\n");
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,97 @@
+/**
+* Interlocking table generator
+* Author: Kyle Sarnik
+*
+* Turns a config file into a header of constant lever and lock rule tables for
+* ilock::StaticInterlocking, so the core can boot without an SD card.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/tablegen.cpp
+*       libraries/iLock/src/iLock.cpp libraries/JSONLoader/src/JSONLoader.cpp -o tablegen
+* Usage:
+*   tablegen [config file] [output header]
+*   tablegen data/config.txt InterlockingCore/ilconfig.h
+**/
+
+#include "HostFrame.h"
+
+using ilock::LockingId;
+using ilock::LockState;
+
+const char* RuleName(ilock::LockingRule rule)
+{
+	switch (rule)
+	{
+	case ilock::LockedAny: return "ilock::LockedAny";
+	case ilock::LockedOn: return "ilock::LockedOn";
+	case ilock::LockedOff: return "ilock::LockedOff";
+	default: return "ilock::Unlocked";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	const char* outPath = argc > 2 ? argv[2] : "InterlockingCore/ilconfig.h";
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	FILE* out = fopen(outPath, "w");
+	if (!out)
+	{
+		fprintf(stderr, "error: cannot write %s\n", outPath);
+		return 1;
+	}
+
+	int levers = (int)frame.levers.size();
+	fprintf(out, "// Interlocking tables generated by HostTools/tablegen from %s, do not edit\n\n", path);
+	fprintf(out, "#pragma once\n\n#include <StaticInterlocking.h>\n\n#define ILCONFIG_TABLES 1\n\nnamespace ilconfig\n{\n\n");
+	fprintf(out, "constexpr int LeverCount = %d;\n\n", levers);
+
+	fprintf(out, "constexpr ilock::StaticLeverData Levers[LeverCount] =\n{\n");
+	for (auto& lever : frame.levers)
+	{
+		fprintf(out, "\t{ \"%s\", %d, %d },\n", lever.name.c_str(), lever.slot.address, lever.slot.slot);
+	}
+	fprintf(out, "};\n\n");
+
+	// Rules in order of acting ID, the fault lock has no rules in the static tables
+	lib::Vector<uint16_t> offsets;
+	offsets.push_back(0);
+	offsets.push_back(0);
+	int ruleCount = 0;
+	lib::String rules;
+	for (int lid = 1; lid <= levers; lid++)
+	{
+		ilock::Locking* locking = frame.il.GetLockingFast((LockingId)lid);
+		for (LockingId target : locking->GetLockTargets())
+		{
+			ilock::LockingRule ruleOn = locking->GetLockRule(LockState::On, target);
+			ilock::LockingRule ruleOff = locking->GetLockRule(LockState::Off, target);
+			if (ruleOn == ilock::Unlocked && ruleOff == ilock::Unlocked)
+				continue;
+
+			char line[128];
+			snprintf(line, sizeof(line), "\t{ %d, %d, %s, %s },\n", lid, target, RuleName(ruleOn), RuleName(ruleOff));
+			rules += line;
+			ruleCount++;
+		}
+		offsets.push_back((uint16_t)ruleCount);
+	}
+
+	fprintf(out, "constexpr int RuleCount = %d;\n\n", ruleCount);
+	fprintf(out, "constexpr ilock::StaticLockRule Rules[RuleCount] =\n{\n%s};\n\n", rules.c_str());
+	fprintf(out, "constexpr uint16_t RuleOffsets[LeverCount + 2] =\n{\n\t");
+	for (size_t i = 0; i < offsets.size(); i++)
+	{
+		fprintf(out, "%d%s", offsets[i], i + 1 < offsets.size() ? ", " : "\n");
+	}
+	fprintf(out, "};\n\n} // namespace ilconfig\n");
+	fclose(out);
+
+	printf("Wrote %d levers and %d rules to %s\n", levers, ruleCount, outPath);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/**
+* Lever throw benchmark
+* Author: Kyle Sarnik
+*
+* Times random throws of unlocked levers on a frame and counts the lock
+* changes they cause, so runs against different engines can be compared.
+* The sweep mode runs synthetic frames of 18 to 250 levers with 4 rules each.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/throw_bench.cpp
+*       libraries/iLock/src/iLock.cpp libraries/JSONLoader/src/JSONLoader.cpp -o throw_bench
+* Usage:
+*   throw_bench [config file] [picks]
+*   throw_bench sweep [picks]
+*
+* To compare against another revision of iLock, build with its sources in place of
+* libraries/iLock/src, Compile() is only called where it exists. The baseline 6b2e11d
+* returns a reference to a temporary from operator!, which breaks toggling at -O2, so
+* those two operators must return by value first, as the next revision made them:
+*   git archive 6b2e11d libraries/iLock | tar -x -C /tmp/base
+*   sed -i 's/const LockState& operator!(LockState& orig)/LockState operator!(LockState orig)/;
+*       s/const Lever::State& operator!(Lever::State& orig)/Lever::State operator!(Lever::State orig)/'
+*       /tmp/base/libraries/iLock/src/iLock.cpp
+* Both builds must report the same throws and lock changes.
+**/
+
+#include "HostFrame.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using lib::Vector;
+using ilock::LockingId;
+using ilock::LockState;
+using LeverState = ilock::Lever::State;
+
+static long lockChanges = 0;
+
+void CountLockChange(LockingId lid, bool locked)
+{
+	lockChanges++;
+}
+
+//! Result of a run of throws
+struct ThrowStats
+{
+	long throws = 0;
+	long lockChanges = 0;
+	double nsPerThrow = 0;
+};
+
+//! Throw random unlocked levers, picks landing on a locked lever are skipped
+ThrowStats RunThrows(ilock::Interlocking& il, const Vector<ilock::Lever*>& levers, long attempts)
+{
+	std::mt19937 rng(1);
+	lockChanges = 0;
+	il.OnLockChange(CountLockChange);
+
+	ThrowStats stats;
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < attempts; i++)
+	{
+		ilock::Lever* lever = levers[rng() % levers.size()];
+		if (lever->IsLocked())
+			continue;
+
+		lever->SetLeverState(lever->GetState() == LockState::On ? LeverState::Reversed : LeverState::Normal);
+		stats.throws++;
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	stats.lockChanges = lockChanges;
+	stats.nsPerThrow = stats.throws ? ns / stats.throws : 0.0;
+	il.OnLockChange(nullptr);
+	return stats;
+}
+
+//! Synthetic frame sizes of the sweep, and rules each lever applies
+const int SweepLevers[] = { 18, 64, 128, 250 };
+constexpr int SweepRules = 4;
+
+//! Time throws on synthetic frames, reversing each lever locks 4 others normal
+void Sweep(long attempts)
+{
+	printf("%8s %8s %14s %10s\n", "levers", "throws", "lock changes", "ns/throw");
+	for (int count : SweepLevers)
+	{
+		ilock::Interlocking il;
+		Vector<ilock::Lever*> levers;
+		for (int i = 0; i < count; i++)
+			levers.push_back(il.AddLever(std::to_string(i)));
+
+		for (int i = 0; i < count; i++)
+		{
+			for (int k = 1; k <= SweepRules; k++)
+			{
+				int target = (i + k * 7) % count;
+				if (target != i)
+					levers[i]->AddLockRule(LockState::Off, levers[target]->GetId(), ilock::LockedOn);
+			}
+		}
+		for (ilock::Lever* lever : levers)
+			lever->FinalizeLockRules();
+		host::Compile(il);
+
+		ThrowStats stats = RunThrows(il, levers, attempts);
+		printf("%8d %8ld %14ld %10.1f\n", count, stats.throws, stats.lockChanges, stats.nsPerThrow);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool sweep = argc > 1 && strcmp(argv[1], "sweep") == 0;
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	long attempts = argc > 2 ? atol(argv[2]) : 2000000;
+	if (attempts <= 0)
+		attempts = 2000000;
+
+	if (sweep)
+	{
+		Sweep(attempts);
+		return 0;
+	}
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	Vector<ilock::Lever*> levers;
+	for (auto& data : frame.levers)
+		levers.push_back(static_cast<ilock::Lever*>(frame.il.GetLocking(data.name)));
+
+	ThrowStats stats = RunThrows(frame.il, levers, attempts);
+	printf("%s: %d levers, %ld throws of %ld picks, %ld lock changes\n", path, (int)levers.size(), stats.throws, attempts, stats.lockChanges);
+	printf("%.1f ns per throw\n", stats.nsPerThrow);
+	return 0;
+}
@@ -0,0 +1,349 @@
+/**
+* Interlocking state-space verifier
+* Author: Kyle Sarnik
+*
+* Enumerates every lever state reachable from all levers Normal using only
+* permitted moves, and reports levers which can never be reversed, lock rules
+* which never hold a lever on their own and pairs of levers which can be
+* reversed together. Work is spread across all cores with work stealing.
+*
+* Build on a host from the repository root:
+*   g++ -O2 -std=c++17 -pthread -DENV_ARDUINO=0 -Ilibraries/CommonLib/src -Ilibraries/iLock/src
+*       -Ilibraries/JSONLoader/src -Ilibraries/ArduinoJson-7.x/src HostTools/verifier.cpp
+*       libraries/iLock/src/iLock.cpp libraries/iLock/src/LockBoard.cpp
+*       libraries/JSONLoader/src/JSONLoader.cpp -o verifier
+* Usage:
+*   verifier [config file] [threads]
+**/
+
+#include "HostFrame.h"
+
+#include <LockBoard.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using ilock::LockingId;
+using ilock::LockState;
+using ilock::LockingRule;
+
+namespace verifier
+{
+
+using lib::Vector;
+
+typedef uint64_t State;
+
+//! Largest frame the visited table is sized for, 2^32 states take 512MB
+constexpr int MaxLevers = 32;
+
+//! Lock masks of one lever, bit n is lever ID n + 1
+struct LeverMasks
+{
+	State lockedWhenOn;
+	State lockedWhenOff;
+};
+
+//! Results gathered by one worker
+struct WorkerStats
+{
+	uint64_t states = 0;
+	State reversed = 0;
+	Vector<State> reversedWith;
+	// Indexed by (acting * levers + target) * 2 + acting state
+	Vector<uint8_t> ruleHeld;
+};
+
+//! Deque of states owned by one worker, others steal from the front
+struct WorkQueue
+{
+	std::mutex lock;
+	std::deque<State> states;
+};
+
+class Verifier
+{
+	int _levers;
+	int _threads;
+	Vector<LeverMasks> _masks;
+	std::atomic<uint64_t>* _visited = nullptr;
+	std::atomic<int64_t> _pending{ 0 };
+	Vector<WorkQueue> _queues;
+	Vector<WorkerStats> _stats;
+
+	//! Mark state visited, returns true if it was not visited before
+	bool Visit(State s)
+	{
+		uint64_t bit = (uint64_t)1 << (s % 64);
+		return !(_visited[s / 64].fetch_or(bit, std::memory_order_relaxed) & bit);
+	}
+
+	State Lockers(State s, int lever) const
+	{
+		return (_masks[lever].lockedWhenOn & ~s) | (_masks[lever].lockedWhenOff & s);
+	}
+
+	void Push(int worker, State s)
+	{
+		_pending.fetch_add(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> guard(_queues[worker].lock);
+		_queues[worker].states.push_back(s);
+	}
+
+	bool Pop(int worker, State& s)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_queues[worker].lock);
+			if (!_queues[worker].states.empty())
+			{
+				s = _queues[worker].states.back();
+				_queues[worker].states.pop_back();
+				return true;
+			}
+		}
+
+		// Steal half of another worker's queue, oldest states first
+		for (int i = 1; i < _threads; i++)
+		{
+			WorkQueue& victim = _queues[(worker + i) % _threads];
+			std::deque<State> stolen;
+			{
+				std::lock_guard<std::mutex> guard(victim.lock);
+				size_t take = (victim.states.size() + 1) / 2;
+				for (size_t n = 0; n < take; n++)
+				{
+					stolen.push_back(victim.states.front());
+					victim.states.pop_front();
+				}
+			}
+			if (stolen.empty())
+				continue;
+
+			s = stolen.back();
+			stolen.pop_back();
+			std::lock_guard<std::mutex> guard(_queues[worker].lock);
+			_queues[worker].states.insert(_queues[worker].states.end(), stolen.begin(), stolen.end());
+			return true;
+		}
+		return false;
+	}
+
+	void Process(int worker, State s)
+	{
+		WorkerStats& stats = _stats[worker];
+		stats.states++;
+		stats.reversed |= s;
+
+		for (int lever = 0; lever < _levers; lever++)
+		{
+			State bit = (State)1 << lever;
+			if (s & bit)
+				stats.reversedWith[lever] |= s;
+
+			State lockers = Lockers(s, lever);
+			if (lockers == 0)
+			{
+				State next = s ^ bit;
+				if (Visit(next))
+					Push(worker, next);
+			}
+			else if ((lockers & (lockers - 1)) == 0)
+			{
+				// A single rule holds this lever, so the rule is doing work in this state
+				int acting = __builtin_ctzll(lockers);
+				int actingState = (s >> acting) & 1;
+				stats.ruleHeld[(acting * _levers + lever) * 2 + actingState] = 1;
+			}
+		}
+	}
+
+	void Run(int worker)
+	{
+		State s;
+		while (_pending.load(std::memory_order_acquire) > 0)
+		{
+			if (!Pop(worker, s))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			Process(worker, s);
+			_pending.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+public:
+	Verifier(ilock::LockBoard& board, int levers, int threads) :
+		_levers(levers),
+		_threads(threads),
+		_queues(threads),
+		_stats(threads)
+	{
+		// Convert board masks to one word per lever, lever IDs start after the fault lock
+		_masks.resize(levers);
+		for (int lever = 0; lever < levers; lever++)
+		{
+			for (LockState state : { LockState::On, LockState::Off })
+			{
+				const ilock::LockBoard::Word* mask = board.GetLockMask((LockingId)(lever + 1), state);
+				State bits = 0;
+				for (int acting = 0; acting < levers; acting++)
+				{
+					int id = acting + 1;
+					if (mask[id / ilock::LockBoard::WordBits] & ((ilock::LockBoard::Word)1 << (id % ilock::LockBoard::WordBits)))
+						bits |= (State)1 << acting;
+				}
+				if (state == LockState::On)
+					_masks[lever].lockedWhenOn = bits;
+				else
+					_masks[lever].lockedWhenOff = bits;
+			}
+		}
+
+		for (WorkerStats& stats : _stats)
+		{
+			stats.reversedWith.assign(levers, 0);
+			stats.ruleHeld.assign(levers * levers * 2, 0);
+		}
+	}
+
+	~Verifier() { delete[] _visited; }
+
+	//! Enumerate all reachable states, merging worker results into the first worker
+	WorkerStats& Enumerate()
+	{
+		size_t words = ((uint64_t)1 << _levers) / 64 + 1;
+		_visited = new std::atomic<uint64_t>[words];
+		for (size_t i = 0; i < words; i++)
+			_visited[i].store(0, std::memory_order_relaxed);
+
+		Visit(0);
+		Push(0, 0);
+
+		Vector<std::thread> workers;
+		for (int i = 0; i < _threads; i++)
+			workers.emplace_back(&Verifier::Run, this, i);
+		for (std::thread& worker : workers)
+			worker.join();
+
+		WorkerStats& total = _stats[0];
+		for (int i = 1; i < _threads; i++)
+		{
+			total.states += _stats[i].states;
+			total.reversed |= _stats[i].reversed;
+			for (int lever = 0; lever < _levers; lever++)
+				total.reversedWith[lever] |= _stats[i].reversedWith[lever];
+			for (size_t r = 0; r < total.ruleHeld.size(); r++)
+				total.ruleHeld[r] |= _stats[i].ruleHeld[r];
+		}
+		return total;
+	}
+};
+
+const char* RuleName(LockingRule rule)
+{
+	switch (rule)
+	{
+	case ilock::LockedAny: return "LockedAny";
+	case ilock::LockedOn: return "LockedOn";
+	case ilock::LockedOff: return "LockedOff";
+	default: return "Unlocked";
+	}
+}
+
+} // namespace verifier
+
+int main(int argc, char** argv)
+{
+	using namespace verifier;
+
+	const char* path = argc > 1 ? argv[1] : "data/config.txt";
+	int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+
+	host::Frame frame;
+	if (!host::LoadFrame(path, frame))
+		return 1;
+
+	int levers = (int)frame.levers.size();
+	if (levers > MaxLevers || levers + 1 != frame.il.GetLockingCount())
+	{
+		fprintf(stderr, "error: frame must have at most %d levers and no other lockings\n", MaxLevers);
+		return 1;
+	}
+
+	ilock::LockBoard board;
+	board.Build(frame.il);
+
+	printf("Verifying %s: %d levers, %d threads\n", path, levers, threads);
+	Verifier verifier(board, levers, threads);
+	auto start = std::chrono::steady_clock::now();
+	WorkerStats& stats = verifier.Enumerate();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Reachable states: %llu of %llu\n", (unsigned long long)stats.states, (unsigned long long)((uint64_t)1 << levers));
+	printf("Time: %.3f s, %.0f states/s\n", seconds, seconds > 0 ? stats.states / seconds : 0.0);
+
+	auto leverName = [&](int lever) { return frame.levers[lever].name.c_str(); };
+
+	printf("\nLevers which can never be reversed:\n");
+	int count = 0;
+	for (int lever = 0; lever < levers; lever++)
+	{
+		if (!(stats.reversed & ((State)1 << lever)))
+		{
+			printf("  %s\n", leverName(lever));
+			count++;
+		}
+	}
+	if (count == 0)
+		printf("  none\n");
+
+	printf("\nLock rules which never hold a lever on their own:\n");
+	count = 0;
+	for (int acting = 0; acting < levers; acting++)
+	{
+		ilock::Locking* locking = frame.il.GetLockingFast((LockingId)(acting + 1));
+		for (LockingId target : locking->GetLockTargets())
+		{
+			for (LockState state : { LockState::On, LockState::Off })
+			{
+				LockingRule rule = locking->GetLockRule(state, target);
+				if (rule == ilock::Unlocked || target == 0)
+					continue;
+
+				int lever = target - 1;
+				if (!stats.ruleHeld[(acting * levers + lever) * 2 + (int)state])
+				{
+					printf("  %s %s: %s %s\n", leverName(acting), state == LockState::On ? "N" : "R",
+						RuleName(rule), leverName(lever));
+					count++;
+				}
+			}
+		}
+	}
+	if (count == 0)
+		printf("  none\n");
+
+	printf("\nLevers which can be reversed together:\n");
+	count = 0;
+	for (int a = 0; a < levers; a++)
+	{
+		for (int b = a + 1; b < levers; b++)
+		{
+			if (stats.reversedWith[a] & ((State)1 << b))
+			{
+				printf("  %s + %s\n", leverName(a), leverName(b));
+				count++;
+			}
+		}
+	}
+	if (count == 0)
+		printf("  none\n");
+
+	return 0;
+}
@@ -7,6 +7,17 @@ hwprofile::ProfileData hwdata = hwprofile::GetProfile(hwprofile::BoardType::Ardu
 //! Pointer to the interlocking class
 ilock::Interlocking* il = nullptr;
 
+//! Route planner over the interlocking, routes are planned once at boot
+ilock::RoutePlanner planner;
+
+#ifdef ILCONFIG_TABLES
+//! Interlocking evaluated from the generated tables, used when no config is found on the SD card
+ilock::StaticInterlocking<ilconfig::LeverCount> staticIl(ilconfig::Levers, ilconfig::Rules, ilconfig::RuleOffsets);
+#endif
+
+//! Indicates the generated tables are in use instead of a loaded config
+bool useStatic = false;
+
 // Loads data from the SD card config file
 DataLoader* LoadData()
 {
@@ -54,7 +65,8 @@ void InitInterlocking(DataLoader& loader)
     for (auto& data : leverData)
     {
         ilock::Lever* lever = il->AddLever(data.name);
-        LeverManager.RegisterLever(data.slot, lever->GetId());
+        if (!LeverManager.RegisterLever(data.slot, lever->GetId()))
+            Log.Error(LeverSlotInvalid, "lever \"" + data.name + "\" has an invalid or duplicate slot");
     }
     // Apply locking rules
     Vector<JSONLoader::InterlockingData> lockingData = loader.GetInterlockingData();
@@ -85,6 +97,34 @@ void InitInterlocking(DataLoader& loader)
         lever->FinalizeLockRules();
     }
 
+    // Compile the finalized rules into the lock graph used when levers move
+    if (!il->Compile())
+        Log.Error(LockGraphTooLarge, F("lock graph too large to compile, using lock rules"));
+
+    // Plan configured routes from the rest state
+    planner.Build(*il);
+    for (auto& data : loader.GetRouteData())
+    {
+        Vector<ilock::LeverMove> levers;
+        for (auto& name : data.reversed)
+        {
+            Locking* lever = il->GetLocking(name);
+            if (lever)
+                levers.push_back(ilock::LeverMove{ lever->GetId(), LeverState::Reversed });
+            else
+                Log.Error(LeverNotFound, "locking \"" + name + "\" not found");
+        }
+        for (auto& name : data.normal)
+        {
+            Locking* lever = il->GetLocking(name);
+            if (lever)
+                levers.push_back(ilock::LeverMove{ lever->GetId(), LeverState::Normal });
+            else
+                Log.Error(LeverNotFound, "locking \"" + name + "\" not found");
+        }
+        planner.AddRoute(data.name, levers.data(), levers.size());
+    }
+
     // Finally we need to iterate every locking a final time to get their initial lock state
     for (auto lid : il->GetAllLockings())
     {
@@ -95,13 +135,212 @@ void InitInterlocking(DataLoader& loader)
     }
 }
 
-bool LeverStateChanged(LockingId lid, LeverState newState)
+void LeverLockChanged(LockingId lid, bool locked);
+
+#ifdef ILCONFIG_TABLES
+//! Set up the interlocking from the generated tables
+void InitStaticInterlocking()
+{
+    for (int i = 0; i < ilconfig::LeverCount; i++)
+    {
+        const ilock::StaticLeverData& data = ilconfig::Levers[i];
+        if (!LeverManager.RegisterLever(DeviceSlot{ data.device, data.slot }, (LockingId)(i + 1)))
+            Log.Error(LeverSlotInvalid, "lever \"" + String(data.name) + "\" has an invalid or duplicate slot");
+    }
+
+    staticIl.Init();
+    staticIl.OnLockChange(LeverLockChanged);
+
+    // Send initial lock state of every lever
+    for (int i = 1; i <= ilconfig::LeverCount; i++)
+        LeverManager.SetLeverLockState((LockingId)i, staticIl.IsLocked((LockingId)i));
+
+    useStatic = true;
+    Log.StaticTables(ilconfig::LeverCount);
+}
+#endif
+
+//! Begin a batch of lever changes on the interlocking in use
+void BeginBatch()
+{
+#ifdef ILCONFIG_TABLES
+    if (useStatic)
+    {
+        staticIl.BeginBatch();
+        return;
+    }
+#endif
+    il->BeginBatch();
+}
+
+//! Commit a batch of lever changes on the interlocking in use
+void CommitBatch()
+{
+#ifdef ILCONFIG_TABLES
+    if (useStatic)
+    {
+        staticIl.CommitBatch();
+        return;
+    }
+#endif
+    il->CommitBatch();
+}
+
+bool LeverStateChanged(LockingId lid, LeverState newState, ilock::LockState& lockState)
 {
+#ifdef ILCONFIG_TABLES
+    if (useStatic)
+    {
+        if (lid == ilock::Interlocking::faultLockId || lid > ilconfig::LeverCount)
+            return false;
+
+        Serial.print(F("state changed for lever "));
+        Serial.print(staticIl.GetName(lid));
+        Serial.print(F(" , new state: "));
+        Serial.println((int)newState);
+
+        // A locked lever keeps its lock state and is faulted instead
+        staticIl.SetLeverState(lid, newState);
+        lockState = staticIl.GetState(lid);
+        return !staticIl.IsFaulted(lid);
+    }
+#endif
+
+    Locking* locking = il->GetLocking(lid);
+    if (!locking || !locking->IsLever())
+        return false;
+
     Serial.print(F("state changed for lever "));
-    Serial.print(il->GetLocking(lid)->GetName());
+    Serial.print(locking->GetName());
     Serial.print(F(" , new state: "));
     Serial.println((int)newState);
-    return true;
+
+    // Apply to the interlocking, lock changes are sent when the current batch commits. A locked
+    // lever keeps its lock state and is faulted instead
+    ilock::Lever* lever = static_cast<ilock::Lever*>(locking);
+    lever->SetLeverState(newState);
+    lockState = lever->GetState();
+    return !lever->IsFaulted();
+}
+
+//! Fault a lever whose module timed out, or restore its own fault state once the module is heard from
+void LeverLost(LockingId lid, bool lost)
+{
+#ifdef ILCONFIG_TABLES
+    if (useStatic)
+    {
+        if (lid == ilock::Interlocking::faultLockId || lid > ilconfig::LeverCount)
+            return;
+
+        bool mismatch = (staticIl.GetLeverState(lid) == LeverState::Normal) != (staticIl.GetState(lid) == ilock::LockState::On);
+        staticIl.SetLeverFaulted(lid, lost || mismatch);
+        if (lost)
+            Log.Error(ModuleLost, "lever \"" + String(staticIl.GetName(lid)) + "\" lost with its module");
+        return;
+    }
+#endif
+
+    Locking* locking = il->GetLocking(lid);
+    if (!locking || !locking->IsLever())
+        return;
+
+    il->SetLeverFaulted(lid, lost || static_cast<ilock::Lever*>(locking)->IsFaulted());
+    if (lost)
+        Log.Error(ModuleLost, "lever \"" + locking->GetName() + "\" lost with its module");
+}
+
+//! Console command, prints the moves to set a route. Format: <route name> or <lever>:<N|R> ...
+void PlanRoute(String args)
+{
+    args.trim();
+    if (!il)
+    {
+        Log.Error(Unknown, F("route planning requires a loaded config"));
+        return;
+    }
+
+    ilock::LeverMove plan[ilock::RoutePlanner::MaxPlanLength];
+
+    // Configured routes are a cached lookup
+    int route = planner.FindRoute(args);
+    if (route >= 0)
+    {
+        int length = planner.PlanRoute(route, *il, plan, ilock::RoutePlanner::MaxPlanLength);
+        Log.RoutePlan(args, *il, plan, length);
+        return;
+    }
+
+    // Otherwise parse a list of lever states and search
+    ilock::LeverMove levers[Glob::maxRouteLevers];
+    int count = 0;
+    int start = 0;
+    while (start < (int)args.length() && count < Glob::maxRouteLevers)
+    {
+        int end = args.indexOf(' ', start);
+        if (end < 0)
+            end = args.length();
+
+        String token = args.substring(start, end);
+        start = end + 1;
+        int split = token.indexOf(':');
+        if (split < 0)
+            continue;
+
+        String name = token.substring(0, split);
+        Locking* lever = il->GetLocking(name);
+        if (!lever)
+        {
+            Log.Error(LeverNotFound, "locking \"" + name + "\" not found");
+            return;
+        }
+        LeverState state = token.endsWith("R") ? LeverState::Reversed : LeverState::Normal;
+        levers[count++] = ilock::LeverMove{ lever->GetId(), state };
+    }
+
+    int length = planner.Plan(levers, count, *il, plan, ilock::RoutePlanner::MaxPlanLength);
+    Log.RoutePlan(args, *il, plan, length);
+}
+
+//! Console command, reports whether a lever may move without moving it. Format: <lever> <N|R>
+void CheckMove(String args)
+{
+    args.trim();
+    int split = args.lastIndexOf(' ');
+    if (split < 0)
+    {
+        Log.Error(Unknown, F("usage: check <lever> <N|R>"));
+        return;
+    }
+
+    String name = args.substring(0, split);
+    LeverState state = args.endsWith("R") ? LeverState::Reversed : LeverState::Normal;
+
+#ifdef ILCONFIG_TABLES
+    // The generated tables only answer whether the move is permitted
+    if (useStatic)
+    {
+        LockingId lid = staticIl.FindLever(name.c_str());
+        if (lid == ilock::Interlocking::faultLockId)
+        {
+            Log.Error(LeverNotFound, "locking \"" + name + "\" not found");
+            return;
+        }
+        Log.MoveCheck(name, state, staticIl.CanMove(lid, state));
+        return;
+    }
+#endif
+
+    Locking* locking = il->GetLocking(name);
+    if (!locking)
+    {
+        Log.Error(LeverNotFound, "locking \"" + name + "\" not found");
+        return;
+    }
+
+    ilock::MoveEffect effects[Glob::maxMoveEffects];
+    bool permitted = il->CanMove(locking->GetId(), state);
+    int count = il->QueryMoveEffects(locking->GetId(), state, effects, Glob::maxMoveEffects);
+    Log.MoveCheck(locking, state, permitted, effects, count);
 }
 
 void LeverLockChanged(LockingId lid, bool locked)
@@ -109,10 +348,10 @@ void LeverLockChanged(LockingId lid, bool locked)
     LeverManager.SetLeverLockState(lid, locked);
 }
 
-void OnRegister(ilmsg::MessageRegister msg)
+void OnRegister(const ilmsg::MessageRegister& msg)
 {
-    Log.ModuleRegistered(msg);
-    LeverManager.OnRegister(msg);
+    bool added = LeverManager.OnRegister(msg);
+    Log.ModuleRegistered(msg, !added);
 }
 
 void setup()
@@ -133,28 +372,38 @@ void setup()
 
     // Set up ILMSG Communication
     ilmsg::Processor.RegisterDevice(ilmsg::ModuleType::Core, 0);
+    ilmsg::Processor.SetReceiveBatch(Glob::receiveBatch, Glob::receiveBudget);
+    ilmsg::Processor.SetReceiveMode(ilmsg::CAN_ReceiveMode::Interrupt);
     if(!ilmsg::Processor.Start(hwdata.canTxPin, hwdata.canRxPin, hwdata.canClockSpeed))
     {
       Log.Error(CANFailed, F("CAN initialization failed"));
     }
-    ilmsg::Processor.OnMessage(ilmsg::MessageType::Register, new ilmsg::MessageProcessFunc<ilmsg::MessageRegister>(OnRegister));
+    ilmsg::Processor.OnMessage(OnRegister);
     ilmsg::Processor.SendMessage(ilmsg::MessageInit());
 
-    // Set up lever coms
+    // Set up lever coms, lock changes go out as one frame per module each loop
     LeverManager.OnStateChanged(LeverStateChanged);
+    LeverManager.OnLeverLost(LeverLost);
+    LeverManager.SetLockSendMode(levercom::LockSendMode::PerModule);
 
-    // Load data
+    // Load data, a config on the SD card takes precedence over the generated tables
     DataLoader* loader = LoadData();
-    if (!loader)
+    if (loader)
     {
+        // Initialize the interlocking
+        InitInterlocking(*loader);
+        il->OnLockChange(LeverLockChanged);
+    }
+    else
+    {
+#ifdef ILCONFIG_TABLES
+        InitStaticInterlocking();
+#else
         Log.Error(Unknown, F("loader pointer is null"));
         return;
+#endif
     }
 
-    // Initialize the interlocking
-    InitInterlocking(*loader);
-    il->OnLockChange(LeverLockChanged);
-
     // Start listening for lever coms
     LeverManager.Start();
 
@@ -170,10 +419,34 @@ void loop()
     return;
 
     // Do nothing if interlocking is null
-    if (!il)
+    if (!il && !useStatic)
     return;
 
-    ilmsg::Processor.ProcessReceived();
+    // Apply all lever changes received this pass as one batch, so only net lock changes go out
+    BeginBatch();
+    ilmsg::ReceiveResult received = ilmsg::Processor.ProcessReceived();
+    CommitBatch();
+    LeverManager.Tick();
+
+    if (received.pending > 0)
+        Log.ReceiveBacklog(received);
+
+    // Report frames dropped by the receive queue since the last pass
+    ilmsg::CAN_RxStats rxStats = ilmsg::Processor.GetRxStats();
+    if (rxStats.overflows != Glob::rxOverflows)
+    {
+        Log.Error(CANOverflow, String(rxStats.overflows - Glob::rxOverflows) + " received frames dropped");
+        Glob::rxOverflows = rxStats.overflows;
+    }
+
+    // Report frames which never made it onto the bus
+    ilmsg::CAN_TxStats txStats = ilmsg::Processor.GetTxStats();
+    uint32_t txLost = txStats.failed + txStats.dropped + ilmsg::Processor.GetSendQueueStats().dropped;
+    if (txLost != Glob::txLost)
+    {
+        Log.Error(CANSendFailed, String(txLost - Glob::txLost) + " frames not sent");
+        Glob::txLost = txLost;
+    }
 
     if (Serial.available() > 0)
     {
@@ -183,5 +456,23 @@ void loop()
         {
             Log.Ping();
         }
+        else if (str.startsWith("check "))
+        {
+            CheckMove(str.substring(6));
+        }
+        else if (str.startsWith("route "))
+        {
+            PlanRoute(str.substring(6));
+        }
+        else if (str == "stats")
+        {
+            Log.CanStats(ilmsg::Processor.GetRxStats(), ilmsg::Processor.GetTxStats(), ilmsg::Processor.GetSendQueueStats());
+            Log.BusStats(ilmsg::Processor.GetBusStats());
+            Log.MessageStats(ilmsg::Processor.GetMessageStats());
+        }
+        else if (str == "stats reset")
+        {
+            ilmsg::Processor.ResetMessageStats();
+        }
     }
 }
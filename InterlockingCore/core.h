@@ -15,11 +15,17 @@ namespace Version
 #define STD_LIB
 #include <CommonLib.h>
 #include <iLock.h>
+#include <RoutePlanner.h>
 #include <JSONLoader.h>
 #include <ilmsg2.h>
 #include <levercom2.h>
 #include <Logger.h>
 
+// Interlocking tables generated from a config at build time, see HostTools/tablegen.cpp
+#if __has_include("ilconfig.h")
+#include "ilconfig.h"
+#endif
+
 // Standard libraries
 #include <limits>
 
@@ -43,6 +49,24 @@ namespace Glob
 
     //! Indicates a successful initialization (config loaded)
     bool initSuccessful = false;
+
+    //! Most lock changes reported for a single console move check
+    constexpr int maxMoveEffects = 32;
+
+    //! Most levers in a console route request
+    constexpr int maxRouteLevers = 16;
+
+    //! Most CAN messages processed each loop, enough to clear a frame's power-up burst
+    constexpr int receiveBatch = 32;
+
+    //! Time budget for processing CAN messages each loop in microseconds
+    constexpr unsigned long receiveBudget = 5000;
+
+    //! Receive queue overflows already reported
+    uint32_t rxOverflows = 0;
+
+    //! Transmit failures and drops already reported
+    uint32_t txLost = 0;
 }
 
 //! Error codes
@@ -54,7 +78,12 @@ enum ErrorCode
     ConfigReadError,
     JSONDeserializeError,
     LeverNotFound,
-    CANFailed
+    CANFailed,
+    CANOverflow,
+    CANSendFailed,
+    LeverSlotInvalid,
+    ModuleLost,
+    LockGraphTooLarge
 };
 
 enum LogType
@@ -106,6 +135,16 @@ public:
         Serial.println(F("[LOG] System initialized..."));
     }
 
+    void StaticTables(int levers)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        Serial.print(F("[LOG] no config loaded, using built-in tables with "));
+        Serial.print(levers);
+        Serial.println(F(" levers"));
+    }
+
     void Ping()
     {
         if (!LogEnabled(General))
@@ -141,16 +180,163 @@ public:
         Serial.println(F(" when OFF"));
     }
 
-    void ModuleRegistered(ilmsg::MessageRegister msg)
+    void MoveCheck(Locking* lever, LeverState state, bool permitted, ilock::MoveEffect* effects, int count)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        Serial.print(F("[LOG] lever "));
+        Serial.print(lever->GetName());
+        Serial.print(state == LeverState::Reversed ? F(" to R: ") : F(" to N: "));
+        Serial.println(permitted ? F("PERMITTED") : F("LOCKED"));
+        for (int i = 0; i < count; i++)
+        {
+            Serial.print(F("[LOG]   "));
+            Serial.print(lever->GetInterlocking()->GetLockingFast(effects[i].lid)->GetName());
+            Serial.println(effects[i].locked ? F(" would lock") : F(" would unlock"));
+        }
+    }
+
+    void MoveCheck(const String& lever, LeverState state, bool permitted)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        Serial.print(F("[LOG] lever "));
+        Serial.print(lever);
+        Serial.print(state == LeverState::Reversed ? F(" to R: ") : F(" to N: "));
+        Serial.println(permitted ? F("PERMITTED") : F("LOCKED"));
+    }
+
+    void RoutePlan(const String& route, Interlocking& interlocking, ilock::LeverMove* plan, int length)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        Serial.print(F("[LOG] route "));
+        Serial.print(route);
+        if (length < 0)
+        {
+            Serial.println(F(": NO PLAN"));
+            return;
+        }
+        Serial.print(F(": "));
+        for (int i = 0; i < length; i++)
+        {
+            Serial.print(interlocking.GetLocking(plan[i].lid)->GetName());
+            Serial.print(plan[i].state == LeverState::Reversed ? F(":R ") : F(":N "));
+        }
+        Serial.println();
+    }
+
+    void ModuleRegistered(const ilmsg::MessageRegister& msg, bool again)
     {
         if (!LogEnabled(MessageCom))
             return;
 
-        Serial.print(F("[LOG] module registered: "));
+        Serial.print(again ? F("[LOG] module registered again: ") : F("[LOG] module registered: "));
         Serial.print(ilmsg::Processor.ModuleTypeToString(msg.mtype));
         Serial.print(F(" at address "));
         Serial.println(msg.did);
     }
+
+    void CanStats(const ilmsg::CAN_RxStats& rx, const ilmsg::CAN_TxStats& tx, const ilmsg::SendQueueStats& send)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        Serial.print(F("[LOG] CAN receive queue: high water "));
+        Serial.print(rx.highWater);
+        Serial.print('/');
+        Serial.print(rx.capacity);
+        Serial.print(F(", overflows "));
+        Serial.println(rx.overflows);
+
+        Serial.print(F("[LOG] CAN transmit: sent "));
+        Serial.print(tx.sent);
+        Serial.print(F(", failed "));
+        Serial.print(tx.failed);
+        Serial.print(F(", dropped "));
+        Serial.print(tx.dropped);
+        Serial.print(F(", queue high water "));
+        Serial.print(tx.highWater);
+        Serial.print('/');
+        Serial.println(tx.capacity);
+
+        Serial.print(F("[LOG] Send queue: depth "));
+        Serial.print(send.depth);
+        Serial.print(F(", high water "));
+        Serial.print(send.highWater);
+        Serial.print('/');
+        Serial.print(send.capacity);
+        Serial.print(F(", replaced "));
+        Serial.print(send.replaced);
+        Serial.print(F(", dropped "));
+        Serial.println(send.dropped);
+    }
+
+    void BusStats(const ilmsg::CAN_BusStats& bus)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        static const char* const states[] = { "active", "passive", "bus off", "unknown" };
+        Serial.print(F("[LOG] CAN bus: "));
+        Serial.print(states[(int)bus.state]);
+        Serial.print(F(", tx errors "));
+        Serial.print(bus.txErrors);
+        Serial.print(F(", rx errors "));
+        Serial.print(bus.rxErrors);
+        Serial.print(F(", bus errors "));
+        Serial.print(bus.busErrors);
+        Serial.print(F(", arbitration lost "));
+        Serial.print(bus.arbitrationLost);
+        Serial.print(F(", rx missed "));
+        Serial.println(bus.rxMissed);
+    }
+
+    void MessageStats(const ilmsg::MessageStats& stats)
+    {
+        if (!LogEnabled(General))
+            return;
+
+        for (int i = 0; i < (int)ilmsg::MessageType::NMessageType; i++)
+        {
+            Serial.print(F("[LOG] "));
+            Serial.print(ilmsg::GetMessageTypeName((ilmsg::MessageType)i));
+            Serial.print(F(": rx "));
+            Serial.print(stats.rx[i]);
+            Serial.print(F(", tx "));
+            Serial.println(stats.tx[i]);
+        }
+        Serial.print(F("[LOG] invalid frames received: "));
+        Serial.println(stats.rxInvalid);
+
+        // Bucket bounds in microseconds, the last bucket is open ended
+        Serial.print(F("[LOG] receive latency (us):"));
+        uint32_t bound = ilmsg::LatencyBucketBase;
+        for (int i = 0; i < ilmsg::LatencyBuckets; i++, bound *= 2)
+        {
+            Serial.print(i < ilmsg::LatencyBuckets - 1 ? F(" <") : F(" >="));
+            Serial.print(i < ilmsg::LatencyBuckets - 1 ? bound : bound / 2);
+            Serial.print(':');
+            Serial.print(stats.latency[i]);
+        }
+        Serial.print(F(", max "));
+        Serial.println(stats.latencyMax);
+    }
+
+    void ReceiveBacklog(const ilmsg::ReceiveResult& result)
+    {
+        if (!LogEnabled(MessageCom))
+            return;
+
+        Serial.print(F("[LOG] processed "));
+        Serial.print(result.processed);
+        Serial.print(F(" messages, "));
+        Serial.print(result.pending);
+        Serial.println(F(" still pending"));
+    }
 };
 
 CoreLogger Log;
\ No newline at end of file
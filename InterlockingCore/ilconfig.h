@@ -0,0 +1,100 @@
+// Interlocking tables generated by HostTools/tablegen from data/config.txt, do not edit
+
+#pragma once
+
+#include <StaticInterlocking.h>
+
+#define ILCONFIG_TABLES 1
+
+namespace ilconfig
+{
+
+constexpr int LeverCount = 18;
+
+constexpr ilock::StaticLeverData Levers[LeverCount] =
+{
+	{ "1", 1, 0 },
+	{ "2", 1, 1 },
+	{ "3", 1, 2 },
+	{ "4", 1, 3 },
+	{ "5", 1, 4 },
+	{ "6", 1, 5 },
+	{ "7", 2, 0 },
+	{ "8", 2, 1 },
+	{ "9", 2, 2 },
+	{ "10", 2, 3 },
+	{ "11", 2, 4 },
+	{ "12", 2, 5 },
+	{ "13", 3, 0 },
+	{ "14", 3, 1 },
+	{ "15", 3, 2 },
+	{ "16", 3, 3 },
+	{ "17", 3, 4 },
+	{ "18", 3, 5 },
+};
+
+constexpr int RuleCount = 53;
+
+constexpr ilock::StaticLockRule Rules[RuleCount] =
+{
+	{ 1, 2, ilock::Unlocked, ilock::LockedOff },
+	{ 1, 5, ilock::Unlocked, ilock::LockedOff },
+	{ 2, 1, ilock::LockedOn, ilock::Unlocked },
+	{ 2, 5, ilock::Unlocked, ilock::LockedOff },
+	{ 2, 8, ilock::Unlocked, ilock::LockedAny },
+	{ 2, 10, ilock::Unlocked, ilock::LockedAny },
+	{ 2, 11, ilock::Unlocked, ilock::LockedAny },
+	{ 2, 4, ilock::Unlocked, ilock::LockedOn },
+	{ 3, 4, ilock::Unlocked, ilock::LockedOff },
+	{ 3, 5, ilock::Unlocked, ilock::LockedOff },
+	{ 4, 3, ilock::LockedOn, ilock::Unlocked },
+	{ 4, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 4, 5, ilock::Unlocked, ilock::LockedOff },
+	{ 4, 10, ilock::Unlocked, ilock::LockedAny },
+	{ 4, 11, ilock::Unlocked, ilock::LockedAny },
+	{ 5, 1, ilock::LockedOn, ilock::Unlocked },
+	{ 5, 3, ilock::LockedOn, ilock::Unlocked },
+	{ 5, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 5, 4, ilock::Unlocked, ilock::LockedOn },
+	{ 8, 9, ilock::LockedAny, ilock::Unlocked },
+	{ 8, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 8, 14, ilock::Unlocked, ilock::LockedOn },
+	{ 8, 17, ilock::Unlocked, ilock::LockedOn },
+	{ 9, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 9, 17, ilock::Unlocked, ilock::LockedOn },
+	{ 9, 14, ilock::LockedOn, ilock::Unlocked },
+	{ 10, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 10, 4, ilock::LockedOn, ilock::Unlocked },
+	{ 11, 12, ilock::LockedAny, ilock::Unlocked },
+	{ 11, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 11, 4, ilock::Unlocked, ilock::LockedOn },
+	{ 11, 14, ilock::Unlocked, ilock::LockedOn },
+	{ 11, 17, ilock::Unlocked, ilock::LockedOn },
+	{ 12, 2, ilock::Unlocked, ilock::LockedOn },
+	{ 12, 4, ilock::Unlocked, ilock::LockedOn },
+	{ 12, 14, ilock::Unlocked, ilock::LockedOn },
+	{ 12, 17, ilock::Unlocked, ilock::LockedOn },
+	{ 13, 15, ilock::LockedOn, ilock::Unlocked },
+	{ 13, 14, ilock::Unlocked, ilock::LockedOn },
+	{ 14, 15, ilock::LockedOn, ilock::Unlocked },
+	{ 14, 13, ilock::Unlocked, ilock::LockedOff },
+	{ 14, 8, ilock::Unlocked, ilock::LockedAny },
+	{ 14, 11, ilock::Unlocked, ilock::LockedAny },
+	{ 15, 13, ilock::Unlocked, ilock::LockedOff },
+	{ 15, 14, ilock::Unlocked, ilock::LockedOff },
+	{ 16, 18, ilock::LockedOn, ilock::Unlocked },
+	{ 16, 17, ilock::Unlocked, ilock::LockedOn },
+	{ 17, 18, ilock::LockedOn, ilock::Unlocked },
+	{ 17, 16, ilock::Unlocked, ilock::LockedOff },
+	{ 17, 8, ilock::Unlocked, ilock::LockedAny },
+	{ 17, 11, ilock::Unlocked, ilock::LockedAny },
+	{ 18, 16, ilock::Unlocked, ilock::LockedOff },
+	{ 18, 17, ilock::Unlocked, ilock::LockedOff },
+};
+
+constexpr uint16_t RuleOffsets[LeverCount + 2] =
+{
+	0, 0, 2, 8, 10, 15, 19, 19, 19, 23, 26, 28, 33, 37, 39, 43, 45, 47, 51, 53
+};
+
+} // namespace ilconfig
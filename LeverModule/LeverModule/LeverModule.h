@@ -15,9 +15,9 @@ enum LeverState : byte
 class Lever
 {
 	int _slot;
-	LeverState _slotState;
-	LeverState _lockState;
-	bool _locked;
+	LeverState _slotState = Normal;
+	LeverState _lockState = Normal;
+	bool _locked = false;
 	int _pinSwitch;
 	int _pinLED;
 	bool _ready = false;
@@ -20,6 +20,16 @@ constexpr int PinTX = 43;
 constexpr int PinRX = 44;
 
 constexpr unsigned long FlashFreq = 100;
+// Input scans between changes of the LED flash phase
+constexpr unsigned long FlashScans = FlashFreq / ilmod::DefaultScanPeriod;
+
+// Most CAN messages processed each loop, and the time budget for them in microseconds
+constexpr int ReceiveBatch = 16;
+constexpr unsigned long ReceiveBudget = 2000;
+
+// CAN driver queue sizes in frames, the RX queue holds a full resync from the core
+constexpr uint16_t TxQueueSize = 8;
+constexpr uint16_t RxQueueSize = 32;
 
 // Hardware setup
 hwprofile::ProfileData hwdata = hwprofile::GetProfile(hwprofile::BoardType::ArduinoESP32);
@@ -29,8 +39,9 @@ namespace Glob
 {
 	int thisAddress = 1;
 	bool indicateLocks = true;
-	auto flashPhase = LOW;
-	auto timePrev = millis();
+	bool flashPhase = false;
+	bool ledsDirty = true;
+	auto timeHeartbeat = millis();
 } //namespace Glob
 
 // Lever member implementations
@@ -49,6 +60,7 @@ void Lever::SetSlotState(LeverState state)
 	if (state != _slotState)
 	{
 		_slotState = state;
+		Glob::ledsDirty = true;
 
 		// Send message to core
 		ilmsg::MessageSetLeverState msg = {};
@@ -69,8 +81,27 @@ void Lever::SetSlotState(LeverState state)
 // Array of all levers
 Lever* levers;
 
+// Debounced lever switch inputs, one bit per slot
+ilmod::InputScanner leverInputs;
+
+// Lock indication LEDs, one bit per slot
+ilmod::OutputStage leverLeds;
+
+//! Work out the LED of every slot, faulted levers flash and locked levers are lit
+uint32_t GetLedBits()
+{
+	uint32_t bits = 0;
+	for (int i = 0; i < SlotCount; i++)
+	{
+		bool lit = levers[i].IsFaulted() ? Glob::flashPhase : Glob::indicateLocks && levers[i].IsLocked();
+		if (lit)
+			bits |= (uint32_t)1 << i;
+	}
+	return bits;
+}
+
 //! Process a SetLockState message
-void OnSetLockState(ilmsg::MessageSetLockState msg)
+void OnSetLockState(const ilmsg::MessageSetLockState& msg)
 {
 	int slot = msg.slot;
 	if (slot >= SlotCount || slot < 0)
@@ -79,12 +110,28 @@ void OnSetLockState(ilmsg::MessageSetLockState msg)
 	// Update the state of the locking
 	levers[slot].SetLockState((LeverState)msg.state);
 	levers[slot].SetLocked(msg.locked);
+	Glob::ledsDirty = true;
+}
+
+//! Process a SetModuleLockState message, carrying every slot of this module
+void OnSetModuleLockState(const ilmsg::MessageSetModuleLockState& msg)
+{
+	for (int slot = 0; slot < SlotCount; slot++)
+	{
+		if (!msg.HasSlot(slot))
+			continue;
+
+		levers[slot].SetLockState((LeverState)msg.GetState(slot));
+		levers[slot].SetLocked(msg.IsLocked(slot));
+	}
+	Glob::ledsDirty = true;
 }
 
 //! Process a SetLockIndication message
-void OnSetLockIndication(ilmsg::MessageSetLockIndication msg)
+void OnSetLockIndication(const ilmsg::MessageSetLockIndication& msg)
 {
 	Glob::indicateLocks = msg.showIndication;
+	Glob::ledsDirty = true;
 }
 
 void setup() 
@@ -111,13 +158,21 @@ void setup()
 	{
 		levers[i] = Lever(i, pinsIn[i], pinsOut[i]);
 	}
+	leverInputs.Begin(pinsIn, SlotCount, LOW);
+	if (hwdata.ledLatchPin >= 0)
+		leverLeds.BeginShiftRegister(hwdata.ledDataPin, hwdata.ledClockPin, hwdata.ledLatchPin, SlotCount);
+	else
+		leverLeds.Begin(pinsOut, SlotCount);
 
 	// Register with Message Processor
 	ilmsg::Processor.RegisterDevice(ilmsg::ModuleType::Lever, Glob::thisAddress);
+	ilmsg::Processor.SetReceiveBatch(ReceiveBatch, ReceiveBudget);
+	ilmsg::Processor.SetQueueSizes(TxQueueSize, RxQueueSize);
 
 	// Set up event callbacks
-	ilmsg::Processor.OnMessage(ilmsg::MessageType::SetLockState, new ilmsg::MessageProcessFunc<ilmsg::MessageSetLockState>(OnSetLockState));
-	ilmsg::Processor.OnMessage(ilmsg::MessageType::SetLockIndication, new ilmsg::MessageProcessFunc<ilmsg::MessageSetLockIndication>(OnSetLockIndication));
+	ilmsg::Processor.OnMessage(OnSetLockState);
+	ilmsg::Processor.OnMessage(OnSetModuleLockState);
+	ilmsg::Processor.OnMessage(OnSetLockIndication);
 
 	// Start Message Processor
 	if(!ilmsg::Processor.Start(hwdata.canTxPin, hwdata.canRxPin, hwdata.canClockSpeed))
@@ -125,6 +180,10 @@ void setup()
     Log.Message(MessageCom, "CAN did not initialize");
   }
 
+	// Announce this module, the core pushes back the full lock state of its levers
+	if (Glob::thisAddress > 0)
+		ilmsg::Processor.SendRegister();
+
   if (Glob::thisAddress < 1)
     Log.Message(General, "Module address is zero, this module will remain inactive.");
   else
@@ -137,34 +196,38 @@ void loop()
 	if (Glob::thisAddress == 0)
 		return;
 
-	// Update the phase of LED flashing
 	auto timeNow = millis();
-	auto timeElapsed = timeNow - Glob::timePrev;
-	if (timeElapsed > FlashFreq)
+
+	// Let the core know this module is still on the bus
+	if (timeNow - Glob::timeHeartbeat >= ilmsg::HeartbeatInterval)
 	{
-		Glob::timePrev = timeNow;
-		Glob::flashPhase = Glob::flashPhase == HIGH ? LOW : HIGH;
+		Glob::timeHeartbeat = timeNow;
+		ilmsg::Processor.SendHeartbeat();
 	}
 
 	// Process incomming messages
 	ilmsg::Processor.ProcessReceived();
 
-	// Update lever status
-	for (int i = 0; i < SlotCount; i++)
+	// Scan lever switches, only debounced changes are sent to the core
+	uint32_t changed = leverInputs.Update(timeNow);
+	for (int i = 0; changed != 0; i++, changed >>= 1)
+	{
+		if (changed & 1)
+			levers[i].SetSlotState(leverInputs.IsOn(i) ? Reversed : Normal);
+	}
+
+	// The flash phase follows the scan count, so it changes on a scan rather than its own timer
+	bool flashPhase = (leverInputs.GetScanCount() / FlashScans) & 1;
+	if (flashPhase != Glob::flashPhase)
+	{
+		Glob::flashPhase = flashPhase;
+		Glob::ledsDirty = true;
+	}
+
+	// Work out the LEDs only after a change, and write only the ones which differ
+	if (Glob::ledsDirty)
 	{
-		// Update LED state
-		auto ledStatus = LOW;
-		if (levers[i].IsFaulted())
-			ledStatus = Glob::flashPhase;
-		else if (Glob::indicateLocks && levers[i].IsLocked())
-			ledStatus = HIGH;
-
-		digitalWrite(levers[i].GetPinOutput(), ledStatus);
-
-		// Update lever state
-		if (digitalRead(levers[i].GetPinInput()) == LOW)
-			levers[i].SetSlotState(Reversed);
-		else
-			levers[i].SetSlotState(Normal);
+		Glob::ledsDirty = false;
+		leverLeds.Apply(GetLedBits());
 	}
 }
@@ -16,6 +16,9 @@
 
 #define REG_CANINTE                0x2b
 #define REG_CANINTF                0x2c
+#define REG_TEC                    0x1c
+#define REG_REC                    0x1d
+#define REG_EFLG                   0x2d
 
 #define FLAG_RXnIE(n)              (0x01 << n)
 #define FLAG_RXnIF(n)              (0x01 << n)
@@ -55,13 +58,29 @@
 #define FLAG_RXM0                  0x20
 #define FLAG_RXM1                  0x40
 
+#define INSTRUCTION_READ_RX_BUFFER(n) (0x90 | (n << 2))
+#define INSTRUCTION_RTS(n)         (0x80 | (0x01 << n))
+#define INSTRUCTION_READ_STATUS    0xa0
+
+// SIDH, SIDL, EID8, EID0 and DLC precede the data in each buffer
+#define BUFFER_HEADER_LENGTH       5
+
+#define STATUS_TXREQ(n)            (0x04 << (n * 2))
+#define STATUS_TXnIF(n)            (0x08 << (n * 2))
+
+#define TX_BUFFER_COUNT            3
+#define TX_BUFFERS_ALL             0x07
+#define TX_PRIORITY_HIGHEST        3
+
 
 MCP2515Class::MCP2515Class() :
   CANControllerClass(),
   _spiSettings(10E6, MSBFIRST, SPI_MODE0),
   _csPin(MCP2515_DEFAULT_CS_PIN),
   _intPin(MCP2515_DEFAULT_INT_PIN),
-  _clockFrequency(MCP2515_DEFAULT_CLOCK_FREQUENCY)
+  _clockFrequency(MCP2515_DEFAULT_CLOCK_FREQUENCY),
+  _txPending(0),
+  _txPriority(0)
 {
 }
 
@@ -157,36 +176,17 @@ void MCP2515Class::end()
 
 int MCP2515Class::endPacket()
 {
-  if (!CANControllerClass::endPacket()) {
-    return 0;
-  }
-
-  int n = 0;
-
-  if (_txExtended) {
-    writeRegister(REG_TXBnSIDH(n), _txId >> 21);
-    writeRegister(REG_TXBnSIDL(n), (((_txId >> 18) & 0x07) << 5) | FLAG_EXIDE | ((_txId >> 16) & 0x03));
-    writeRegister(REG_TXBnEID8(n), (_txId >> 8) & 0xff);
-    writeRegister(REG_TXBnEID0(n), _txId & 0xff);
-  } else {
-    writeRegister(REG_TXBnSIDH(n), _txId >> 3);
-    writeRegister(REG_TXBnSIDL(n), _txId << 5);
-    writeRegister(REG_TXBnEID8(n), 0x00);
-    writeRegister(REG_TXBnEID0(n), 0x00);
+  // wait for a free buffer, frames sent asynchronously go out first
+  while (!txBufferFree()) {
+    pollTransmit();
+    yield();
   }
 
-  if (_txRtr) {
-    writeRegister(REG_TXBnDLC(n), 0x40 | _txLength);
-  } else {
-    writeRegister(REG_TXBnDLC(n), _txLength);
-
-    for (int i = 0; i < _txLength; i++) {
-      writeRegister(REG_TXBnD0(n) + i, _txData[i]);
-    }
+  int n = endPacketAsync() - 1;
+  if (n < 0) {
+    return 0;
   }
 
-  writeRegister(REG_TXBnCTRL(n), 0x08);
-
   bool aborted = false;
 
   while (readRegister(REG_TXBnCTRL(n)) & 0x08) {
@@ -206,19 +206,127 @@ int MCP2515Class::endPacket()
   }
 
   modifyRegister(REG_CANINTF, FLAG_TXnIF(n), 0x00);
+  _txPending &= ~(0x01 << n);
 
   return (readRegister(REG_TXBnCTRL(n)) & 0x70) ? 0 : 1;
 }
 
+int MCP2515Class::endPacketAsync()
+{
+  if (!txBufferFree()) {
+    return 0;
+  }
+
+  if (!CANControllerClass::endPacket()) {
+    return 0;
+  }
+
+  // the chip sends the highest priority buffer first, so each frame queued
+  // behind others gets a lower priority to keep frames in order
+  if (_txPending == 0) {
+    _txPriority = TX_PRIORITY_HIGHEST;
+  }
+
+  int n = 0;
+  while (_txPending & (0x01 << n)) {
+    n++;
+  }
+
+  uint8_t header[BUFFER_HEADER_LENGTH];
+
+  if (_txExtended) {
+    header[0] = _txId >> 21;
+    header[1] = (((_txId >> 18) & 0x07) << 5) | FLAG_EXIDE | ((_txId >> 16) & 0x03);
+    header[2] = (_txId >> 8) & 0xff;
+    header[3] = _txId & 0xff;
+  } else {
+    header[0] = _txId >> 3;
+    header[1] = _txId << 5;
+    header[2] = 0x00;
+    header[3] = 0x00;
+  }
+
+  if (_txRtr) {
+    header[4] = 0x40 | _txLength;
+  } else {
+    header[4] = _txLength;
+  }
+
+  // load the whole frame in one burst, then request it be sent
+  loadTxBuffer(n, _txPriority, header, _txRtr ? 0 : _txLength);
+  requestToSend(n);
+
+  _txPending |= 0x01 << n;
+  _txPriority--;
+
+  return n + 1;
+}
+
+bool MCP2515Class::txBufferFree()
+{
+  if (_txPending == TX_BUFFERS_ALL) {
+    return false;
+  }
+
+  // once the lowest priority is used, wait for all buffers to finish
+  return _txPending == 0 || _txPriority >= 0;
+}
+
+int MCP2515Class::pollTransmit(int* failed)
+{
+  if (failed) {
+    *failed = 0;
+  }
+
+  if (_txPending == 0) {
+    return 0;
+  }
+
+  uint8_t status = readStatus();
+  int sent = 0;
+  int aborted = 0;
+
+  for (int n = 0; n < TX_BUFFER_COUNT; n++) {
+    if (!(_txPending & (0x01 << n)) || (status & STATUS_TXREQ(n))) {
+      continue;
+    }
+
+    // a finished buffer without its interrupt flag was aborted
+    if (status & STATUS_TXnIF(n)) {
+      sent |= 0x01 << n;
+    } else {
+      aborted |= 0x01 << n;
+    }
+  }
+
+  if (sent) {
+    modifyRegister(REG_CANINTF, sent << 2, 0x00);
+  }
+
+  _txPending &= ~(sent | aborted);
+
+  if (failed) {
+    *failed = aborted;
+  }
+
+  return sent;
+}
+
+void MCP2515Class::abortPacket(int n)
+{
+  modifyRegister(REG_TXBnCTRL(n), 0x08, 0x00);
+}
+
 int MCP2515Class::parsePacket()
 {
   int n;
 
-  uint8_t intf = readRegister(REG_CANINTF);
+  // the RXnIF flags are the low bits of the status
+  uint8_t status = readStatus();
 
-  if (intf & FLAG_RXnIF(0)) {
+  if (status & FLAG_RXnIF(0)) {
     n = 0;
-  } else if (intf & FLAG_RXnIF(1)) {
+  } else if (status & FLAG_RXnIF(1)) {
     n = 1;
   } else {
     _rxId = -1;
@@ -228,36 +336,65 @@ int MCP2515Class::parsePacket()
     return 0;
   }
 
-  _rxExtended = (readRegister(REG_RXBnSIDL(n)) & FLAG_IDE) ? true : false;
+  // read the whole buffer in one burst, the chip clears RXnIF when it ends
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(INSTRUCTION_READ_RX_BUFFER(n));
+
+  uint8_t header[BUFFER_HEADER_LENGTH];
+  for (int i = 0; i < BUFFER_HEADER_LENGTH; i++) {
+    header[i] = SPI.transfer(0x00);
+  }
+
+  _rxExtended = (header[1] & FLAG_IDE) ? true : false;
 
-  uint32_t idA = ((readRegister(REG_RXBnSIDH(n)) << 3) & 0x07f8) | ((readRegister(REG_RXBnSIDL(n)) >> 5) & 0x07);
+  uint32_t idA = ((header[0] << 3) & 0x07f8) | ((header[1] >> 5) & 0x07);
   if (_rxExtended) {
-    uint32_t idB = (((uint32_t)(readRegister(REG_RXBnSIDL(n)) & 0x03) << 16) & 0x30000) | ((readRegister(REG_RXBnEID8(n)) << 8) & 0xff00) | readRegister(REG_RXBnEID0(n));
+    uint32_t idB = (((uint32_t)(header[1] & 0x03) << 16) & 0x30000) | ((header[2] << 8) & 0xff00) | header[3];
 
     _rxId = (idA << 18) | idB;
-    _rxRtr = (readRegister(REG_RXBnDLC(n)) & FLAG_RTR) ? true : false;
+    _rxRtr = (header[4] & FLAG_RTR) ? true : false;
   } else {
     _rxId = idA;
-    _rxRtr = (readRegister(REG_RXBnSIDL(n)) & FLAG_SRR) ? true : false;
+    _rxRtr = (header[1] & FLAG_SRR) ? true : false;
   }
-  _rxDlc = readRegister(REG_RXBnDLC(n)) & 0x0f;
+  _rxDlc = header[4] & 0x0f;
   _rxIndex = 0;
 
   if (_rxRtr) {
     _rxLength = 0;
   } else {
-    _rxLength = _rxDlc;
+    // a DLC above 8 still carries 8 data bytes
+    _rxLength = _rxDlc > 8 ? 8 : _rxDlc;
 
     for (int i = 0; i < _rxLength; i++) {
-      _rxData[i] = readRegister(REG_RXBnD0(n) + i);
+      _rxData[i] = SPI.transfer(0x00);
     }
   }
 
-  modifyRegister(REG_CANINTF, FLAG_RXnIF(n), 0x00);
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
 
   return _rxDlc;
 }
 
+int MCP2515Class::pendingPackets()
+{
+  uint8_t status = readStatus();
+
+  return ((status & FLAG_RXnIF(0)) ? 1 : 0) + ((status & FLAG_RXnIF(1)) ? 1 : 0);
+}
+
+uint8_t MCP2515Class::readErrors(uint8_t* tec, uint8_t* rec)
+{
+  uint8_t counters[2];
+  readRegisters(REG_TEC, counters, 2);
+  *tec = counters[0];
+  *rec = counters[1];
+
+  return readRegister(REG_EFLG);
+}
+
 void MCP2515Class::onReceive(void(*callback)(int))
 {
   CANControllerClass::onReceive(callback);
@@ -409,8 +546,11 @@ void MCP2515Class::setClockFrequency(long clockFrequency)
 
 void MCP2515Class::dumpRegisters(Stream& out)
 {
+  uint8_t values[128];
+  readRegisters(0x00, values, sizeof(values));
+
   for (int i = 0; i < 128; i++) {
-    byte b = readRegister(i);
+    byte b = values[i];
 
     out.print("0x");
     if (i < 16) {
@@ -462,6 +602,60 @@ uint8_t MCP2515Class::readRegister(uint8_t address)
   return value;
 }
 
+void MCP2515Class::readRegisters(uint8_t address, uint8_t* values, int count)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x03);
+  SPI.transfer(address);
+  for (int i = 0; i < count; i++) {
+    values[i] = SPI.transfer(0x00);
+  }
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+uint8_t MCP2515Class::readStatus()
+{
+  uint8_t status;
+
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(INSTRUCTION_READ_STATUS);
+  status = SPI.transfer(0x00);
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+
+  return status;
+}
+
+void MCP2515Class::loadTxBuffer(int n, int priority, const uint8_t* header, int dataLength)
+{
+  // sequential write from the control register sets the priority in the same burst
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x02);
+  SPI.transfer(REG_TXBnCTRL(n));
+  SPI.transfer(priority & 0x03);
+  for (int i = 0; i < BUFFER_HEADER_LENGTH; i++) {
+    SPI.transfer(header[i]);
+  }
+  for (int i = 0; i < dataLength; i++) {
+    SPI.transfer(_txData[i]);
+  }
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+void MCP2515Class::requestToSend(int n)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(INSTRUCTION_RTS(n));
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
 void MCP2515Class::modifyRegister(uint8_t address, uint8_t mask, uint8_t value)
 {
   SPI.beginTransaction(_spiSettings);
@@ -32,7 +32,18 @@ public:
 
   virtual int endPacket();
 
+  // non-blocking transmit across all three TX buffers, returns the buffer number
+  // plus one, or zero with the packet still begun if no buffer is free
+  int endPacketAsync();
+  bool txBufferFree();
+  // returns a mask of buffers sent since the last poll, failed gets a mask of aborted buffers
+  int pollTransmit(int* failed = NULL);
+  void abortPacket(int n);
+
   virtual int parsePacket();
+  int pendingPackets();
+  // reads the transmit and receive error counters, returns the error flag register
+  uint8_t readErrors(uint8_t* tec, uint8_t* rec);
 
   virtual void onReceive(void(*callback)(int));
 
@@ -58,6 +69,10 @@ private:
   void handleInterrupt();
 
   uint8_t readRegister(uint8_t address);
+  void readRegisters(uint8_t address, uint8_t* values, int count);
+  uint8_t readStatus();
+  void loadTxBuffer(int n, int priority, const uint8_t* header, int dataLength);
+  void requestToSend(int n);
   void modifyRegister(uint8_t address, uint8_t mask, uint8_t value);
   void writeRegister(uint8_t address, uint8_t value);
 
@@ -68,6 +83,8 @@ private:
   int _csPin;
   int _intPin;
   long _clockFrequency;
+  uint8_t _txPending;
+  int8_t _txPriority;
 };
 
 extern MCP2515Class CAN;
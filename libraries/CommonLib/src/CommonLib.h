@@ -5,7 +5,10 @@
 
 #pragma once
 
+// Define ENV_ARDUINO as 0 to build for a host with the standard library only
+#ifndef ENV_ARDUINO
 #define ENV_ARDUINO 1
+#endif
 #ifndef NO_STD_LIB
 #define STD_LIB
 #endif
@@ -19,6 +22,7 @@
 #else
 #include <string>
 #endif
+#include <stdint.h>
 
 #if ENV_ARDUINO < 1
 #define STD_LIB
@@ -126,6 +130,67 @@ public:
 	char* GetCharArray() const { return (char*)bytes; }
 };
 
+//! Fixed size ring buffer with one producer and one consumer, such as an interrupt handler
+//! and the main loop. Never allocates or blocks, a push to a full ring is dropped and counted.
+//! N must be a power of two no greater than 128, so byte indices never wrap ambiguously.
+template <typename T, int N>
+class SpscRing
+{
+	static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "ring size must be a power of two up to 128");
+
+	T _items[N];
+	// Free running indices, head is written only by the producer and tail only by the consumer
+	byte _head = 0;
+	byte _tail = 0;
+	// Written only by the producer
+	uint32_t _overflows = 0;
+	byte _highWater = 0;
+
+public:
+	//! Producer side, push an item. Returns false if the ring is full.
+	bool Push(const T& item)
+	{
+		byte head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+		byte used = head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+		if (used >= N)
+		{
+			__atomic_store_n(&_overflows, _overflows + 1, __ATOMIC_RELAXED);
+			return false;
+		}
+
+		_items[head & (N - 1)] = item;
+		__atomic_store_n(&_head, (byte)(head + 1), __ATOMIC_RELEASE);
+
+		if (used + 1 > _highWater)
+			__atomic_store_n(&_highWater, (byte)(used + 1), __ATOMIC_RELAXED);
+		return true;
+	}
+
+	//! Consumer side, pop the oldest item. Returns false if the ring is empty.
+	bool Pop(T& item)
+	{
+		byte tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+		if (tail == __atomic_load_n(&_head, __ATOMIC_ACQUIRE))
+			return false;
+
+		item = _items[tail & (N - 1)];
+		__atomic_store_n(&_tail, (byte)(tail + 1), __ATOMIC_RELEASE);
+		return true;
+	}
+
+	//! Get number of items waiting
+	int Size() const { return (byte)(__atomic_load_n(&_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)); }
+
+	//! Get number of items the ring holds
+	constexpr static int Capacity() { return N; }
+
+	//! Get number of pushes dropped because the ring was full
+	uint32_t GetOverflowCount() const { return __atomic_load_n(&_overflows, __ATOMIC_RELAXED); }
+
+	//! Get the most items ever waiting at once
+	int GetHighWater() const { return __atomic_load_n(&_highWater, __ATOMIC_RELAXED); }
+};
+
 typedef byte DeviceId;
 typedef byte SlotId;
 
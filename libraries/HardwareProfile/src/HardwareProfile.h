@@ -25,6 +25,10 @@ struct ProfileData
 	int canTxPin;
 	int canRxPin;
 	long canClockSpeed = 16E6;
+	// LED shift register pins, no latch pin when the LEDs are on lockIndicatorPins
+	int ledDataPin = -1;
+	int ledClockPin = -1;
+	int ledLatchPin = -1;
 };
 
 ProfileData GetProfile(BoardType type);
@@ -22,5 +22,132 @@ byte ReadBitAddress(int pins[7], int onState)
 	return (byte)address;
 }
 
+void InputScanner::Begin(const int* pins, int count, int onState, unsigned long periodMs)
+{
+	_count = count < MaxScanInputs ? count : MaxScanInputs;
+	_activeLow = onState == LOW;
+	_period = periodMs;
+	for (int i = 0; i < _count; i++)
+	{
+		_pins[i] = pins[i];
+
+#ifdef portInputRegister
+		// Group inputs by port so each port is read once per scan
+		PortRegister port = portInputRegister(digitalPinToPort(pins[i]));
+		int p = 0;
+		while (p < _portCount && _ports[p] != port)
+			p++;
+		if (p == _portCount)
+			_ports[_portCount++] = port;
+
+		_inputPort[i] = (byte)p;
+		_inputMask[i] = digitalPinToBitMask(pins[i]);
+#endif
+	}
+}
+
+uint32_t InputScanner::Sample() const
+{
+	uint32_t bits = 0;
+
+#ifdef portInputRegister
+	uint32_t values[MaxScanInputs];
+	for (int p = 0; p < _portCount; p++)
+		values[p] = *_ports[p];
+
+	for (int i = 0; i < _count; i++)
+	{
+		bool high = (values[_inputPort[i]] & _inputMask[i]) != 0;
+		if (high != _activeLow)
+			bits |= (uint32_t)1 << i;
+	}
+#else
+	for (int i = 0; i < _count; i++)
+	{
+		bool high = digitalRead(_pins[i]) == HIGH;
+		if (high != _activeLow)
+			bits |= (uint32_t)1 << i;
+	}
+#endif
+
+	return bits;
+}
+
+uint32_t InputScanner::Update(unsigned long now)
+{
+	if (now - _lastScan < _period)
+		return 0;
+
+	_lastScan = now;
+	_scans++;
+	_samples[_nextSample] = Sample();
+	_nextSample = (_nextSample + 1) % DebounceSamples;
+
+	// An input turns on once every kept scan has it on and off once none do, otherwise it holds
+	uint32_t allOn = 0xFFFFFFFF;
+	uint32_t anyOn = 0;
+	for (int i = 0; i < DebounceSamples; i++)
+	{
+		allOn &= _samples[i];
+		anyOn |= _samples[i];
+	}
+
+	uint32_t prev = _state;
+	_state = allOn | (_state & anyOn);
+	return _state ^ prev;
+}
+
+void OutputStage::Begin(const int* pins, int count)
+{
+	_count = count < MaxStageOutputs ? count : MaxStageOutputs;
+	_latchPin = -1;
+	for (int i = 0; i < _count; i++)
+	{
+		_pins[i] = pins[i];
+		pinMode(pins[i], OUTPUT);
+		digitalWrite(pins[i], LOW);
+	}
+	_applied = 0;
+}
+
+void OutputStage::BeginShiftRegister(int dataPin, int clockPin, int latchPin, int count)
+{
+	_count = count < MaxStageOutputs ? count : MaxStageOutputs;
+	_dataPin = dataPin;
+	_clockPin = clockPin;
+	_latchPin = latchPin;
+	pinMode(dataPin, OUTPUT);
+	pinMode(clockPin, OUTPUT);
+	pinMode(latchPin, OUTPUT);
+
+	// Clear the registers, Apply only shifts when a bit changes
+	_applied = 0xFFFFFFFF;
+	Apply(0);
+}
+
+void OutputStage::Apply(uint32_t bits)
+{
+	uint32_t changed = bits ^ _applied;
+	if (changed == 0)
+		return;
+
+	_applied = bits;
+	if (_latchPin >= 0)
+	{
+		// Registers only hold whole bytes, shift the full chain out and latch it once
+		digitalWrite(_latchPin, LOW);
+		for (int b = (_count - 1) / 8; b >= 0; b--)
+			shiftOut(_dataPin, _clockPin, MSBFIRST, (byte)(bits >> (b * 8)));
+		digitalWrite(_latchPin, HIGH);
+		return;
+	}
+
+	for (int i = 0; changed != 0; i++, changed >>= 1)
+	{
+		if (changed & 1)
+			digitalWrite(_pins[i], (bits >> i) & 1 ? HIGH : LOW);
+	}
+}
+
 } // namespace ilmod
 	
\ No newline at end of file
@@ -15,5 +15,88 @@ using lib::Buffer;
 //! Get 0-127 address from 7bit pin input
 byte ReadBitAddress(int pins[7], int onState = LOW);
 
+//! Default time between input scans in milliseconds
+constexpr unsigned long DefaultScanPeriod = 5;
+//! Scans in a row which must agree before an input changes state
+constexpr int DebounceSamples = 4;
+//! Most inputs handled by one scanner, one bit each
+constexpr int MaxScanInputs = 32;
+//! Most outputs driven by one output stage, one bit each
+constexpr int MaxStageOutputs = 32;
+
+//! Samples a set of input pins at a fixed rate and debounces them together, one bit per input.
+//! An input only changes once DebounceSamples scans in a row agree, so a bouncing contact
+//! gives a single edge. Pins sharing a port are read with one register read where the board
+//! provides port registers.
+class InputScanner
+{
+#ifdef portInputRegister
+	typedef decltype(portInputRegister(0)) PortRegister;
+
+	// Input register of each distinct port, and the port and bit of each input
+	PortRegister _ports[MaxScanInputs];
+	int _portCount = 0;
+	byte _inputPort[MaxScanInputs];
+	uint32_t _inputMask[MaxScanInputs];
+#endif
+	int _pins[MaxScanInputs];
+	int _count = 0;
+	bool _activeLow = true;
+	unsigned long _period = DefaultScanPeriod;
+	unsigned long _lastScan = 0;
+
+	// Last DebounceSamples scans, oldest replaced first
+	uint32_t _samples[DebounceSamples] = {};
+	int _nextSample = 0;
+	uint32_t _state = 0;
+	unsigned long _scans = 0;
+
+	//! Read all inputs once, bit set for inputs at the on state
+	uint32_t Sample() const;
+
+public:
+	//! Set up the scanner, pins must already be set as inputs. Every input starts off, an input
+	//! held on at start gives an edge once debounced.
+	void Begin(const int* pins, int count, int onState = LOW, unsigned long periodMs = DefaultScanPeriod);
+
+	//! Scan the inputs if a scan period has passed, returns the inputs whose debounced state changed
+	uint32_t Update(unsigned long now);
+
+	//! Get debounced state of every input, bit set for inputs at the on state
+	uint32_t GetState() const { return _state; }
+
+	//! Get debounced state of an input
+	bool IsOn(int input) const { return _state & ((uint32_t)1 << input); }
+
+	//! Get number of scans taken, counts up once every scan period
+	unsigned long GetScanCount() const { return _scans; }
+};
+
+//! Drives a set of outputs from a bitmap, one bit per output, writing only the outputs which
+//! changed since the last apply. Outputs are either pins of their own or the bits of a chain
+//! of shift registers, output 0 on the first output of the register nearest the board.
+class OutputStage
+{
+	int _pins[MaxStageOutputs];
+	int _count = 0;
+	int _dataPin = -1;
+	int _clockPin = -1;
+	int _latchPin = -1;
+	uint32_t _applied = 0;
+
+public:
+	//! Set up outputs on their own pins, every output starts off
+	void Begin(const int* pins, int count);
+
+	//! Set up outputs on a chain of shift registers, every output starts off
+	void BeginShiftRegister(int dataPin, int clockPin, int latchPin, int count);
+
+	//! Drive the outputs to the bitmap, bit set for on
+	void Apply(uint32_t bits);
+
+	//! Get the bitmap last applied
+	uint32_t GetApplied() const { return _applied; }
+};
+
 
 } // namespace levercom
@@ -8,6 +8,7 @@ void ESP32Controller::ConvertToMessage(Message& msg, CanFrame& frame)
 {
 	msg.id = frame.identifier;
 	msg.dataSize = frame.data_length_code;
+	msg.rxMicros = micros();
 	for (int i = 0; i < frame.data_length_code; i++)
 	{
 		msg.data[i] = frame.data[i];
@@ -31,13 +32,22 @@ bool ESP32Controller::Start()
 	filter.acceptance_code = _filter.code;
 	filter.acceptance_mask = _filter.mask;
 	filter.single_filter = true;
-	return ESP32Can.begin(TWAI_SPEED_500KBPS, _txPin, _rxPin, 0xFFFF, 0xFFFF, &filter);
+
+	// The driver keeps its own queue sizes when passed 0xFFFF
+	uint16_t txQueue = _txQueueSize == DefaultQueueSize ? 0xFFFF : _txQueueSize;
+	uint16_t rxQueue = _rxQueueSize == DefaultQueueSize ? 0xFFFF : _rxQueueSize;
+	return ESP32Can.begin(TWAI_SPEED_500KBPS, _txPin, _rxPin, txQueue, rxQueue, &filter);
 }
 
 bool ESP32Controller::Read(Message& msg)
+{
+	return ReadBlocking(msg, 0);
+}
+
+bool ESP32Controller::ReadBlocking(Message& msg, unsigned long timeoutMs)
 {
 	CanFrame frame;
-	if (ESP32Can.readFrame(frame))
+	if (ESP32Can.readFrame(frame, timeoutMs))
 	{
 		ConvertToMessage(msg, frame);
 		return true;
@@ -49,7 +59,44 @@ void ESP32Controller::Write(Message& msg)
 {
 	CanFrame frame;
 	ConvertToFrame(frame, msg);
-	ESP32Can.writeFrame(frame);
+
+	// The driver queues frames itself, a full queue is the only failure seen here
+	if (!ESP32Can.writeFrame(frame, 0))
+		_txDropped++;
+}
+
+bool ESP32Controller::TxReady()
+{
+	// The controller holds a single frame for sending, anything more waits in the driver queue
+	return ESP32Can.inTxQueue() == 0;
+}
+
+TxStats ESP32Controller::GetTxStats() const
+{
+	return TxStats{ 0, 0, _txDropped, 0, 0 };
+}
+
+BusStats ESP32Controller::GetBusStats()
+{
+	twai_status_info_t status;
+	if (twai_get_status_info(&status) != ESP_OK)
+		return BusStats{ BusState::Unknown, 0, 0, 0, 0, 0 };
+
+	BusState state = BusState::Active;
+	if (status.state == TWAI_STATE_BUS_OFF || status.state == TWAI_STATE_RECOVERING)
+		state = BusState::BusOff;
+	else if (status.state == TWAI_STATE_STOPPED)
+		state = BusState::Unknown;
+	else if (status.tx_error_counter >= 128 || status.rx_error_counter >= 128)
+		state = BusState::Passive;
+
+	return BusStats{ state, (uint8_t)status.tx_error_counter, (uint8_t)status.rx_error_counter,
+		status.bus_error_count, status.arb_lost_count, status.rx_missed_count };
+}
+
+int ESP32Controller::Pending()
+{
+	return (int)ESP32Can.inRxQueue();
 }
 
 }
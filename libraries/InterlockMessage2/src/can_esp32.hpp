@@ -9,6 +9,8 @@ namespace can
 
 class ESP32Controller : public CanController
 {
+	uint32_t _txDropped = 0;
+
 	void ConvertToMessage(Message& msg, CanFrame& frame);
 	void ConvertToFrame(CanFrame& frame, Message& msg);
 
@@ -16,7 +18,12 @@ public:
 	virtual ~ESP32Controller() {}
 	bool Start() override;
 	bool Read(Message& msg) override;
+	bool ReadBlocking(Message& msg, unsigned long timeoutMs) override;
 	void Write(Message& mesg) override;
+	bool TxReady() override;
+	TxStats GetTxStats() const override;
+	BusStats GetBusStats() override;
+	int Pending() override;
 };
 
 }
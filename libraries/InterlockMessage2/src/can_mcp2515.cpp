@@ -4,25 +4,51 @@
 namespace can
 {
 
+lib::SpscRing<Message, RxRingSize> MCP2515Controller::_rxRing;
+
+void MCP2515Controller::OnReceive(int packetSize)
+{
+	// Runs in the interrupt, the library has already parsed the frame
+	Message msg;
+	if (ReadPacket(msg))
+		_rxRing.Push(msg);
+}
+
 bool MCP2515Controller::Start()
 {
 	CAN.setPins(_txPin, _rxPin);
 	CAN.setClockFrequency(_clockSpeed);
 	CAN.filterExtended(_filter.code, _filter.mask);
-	return CAN.begin(500E3);
+	if (!CAN.begin(500E3))
+		return false;
+
+	if (_receiveMode == ReceiveMode::Interrupt)
+		CAN.onReceive(OnReceive);
+	return true;
 }
 
 bool MCP2515Controller::Read(Message& msg)
 {
+	if (_receiveMode == ReceiveMode::Interrupt)
+		return _rxRing.Pop(msg);
+
 	if (CAN.parsePacket() <= 0)
 		return false;
 
+	return ReadPacket(msg);
+}
+
+bool MCP2515Controller::ReadPacket(Message& msg)
+{
 	if (!CAN.packetExtended())
 		return false;
 
-	msg.dataSize = CAN.packetDlc();
+	// The DLC field can read up to 15, the library only holds the 8 data bytes
+	int length = CAN.available();
+	msg.dataSize = length;
 	msg.id = CAN.packetId();
-	for (int i = 0; i < CAN.packetDlc(); i++)
+	msg.rxMicros = micros();
+	for (int i = 0; i < length; i++)
 	{
 		msg.data[i] = CAN.read();
 	}
@@ -30,14 +56,122 @@ bool MCP2515Controller::Read(Message& msg)
 	return true;
 }
 
+bool MCP2515Controller::ReadBlocking(Message& msg, unsigned long timeoutMs)
+{
+	unsigned long start = millis();
+	do
+	{
+		if (Read(msg))
+			return true;
+	} while (millis() - start < timeoutMs);
+
+	return false;
+}
+
 void MCP2515Controller::Write(Message& msg)
 {
+	Poll();
+
+	// Queued frames go first to keep the order of frames
+	if (_txQueue.Size() == 0 && Load(msg))
+		return;
+
+	_txQueue.Push(msg);
+}
+
+bool MCP2515Controller::Load(const Message& msg)
+{
+	if (!CAN.txBufferFree())
+		return false;
+
 	CAN.beginExtendedPacket(msg.id, msg.dataSize);
 	for (int i = 0; i < msg.dataSize; i++)
 	{
 		CAN.write(msg.data[i]);
 	}
-	CAN.endPacket();
+
+	int n = CAN.endPacketAsync() - 1;
+	if (n < 0)
+		return false;
+
+	_txLoaded |= 1 << n;
+	_txLoadedAt[n] = millis();
+	return true;
+}
+
+bool MCP2515Controller::TxReady()
+{
+	return _txQueue.Size() == 0 && CAN.txBufferFree();
+}
+
+void MCP2515Controller::Poll()
+{
+	if (_txLoaded == 0 && _txQueue.Size() == 0)
+		return;
+
+	int failed = 0;
+	int sent = CAN.pollTransmit(&failed);
+	_txLoaded &= ~(sent | failed);
+
+	unsigned long now = millis();
+	for (int n = 0; n < TxBufferCount; n++)
+	{
+		if (sent & (1 << n))
+			_txSent++;
+		if (failed & (1 << n))
+			_txFailed++;
+
+		// Nothing acknowledges the frame, abort it so the buffer frees up; reported as failed on the next poll
+		if ((_txLoaded & (1 << n)) && now - _txLoadedAt[n] > TxTimeoutMs)
+		{
+			CAN.abortPacket(n);
+			_txLoadedAt[n] = now;
+		}
+	}
+
+	Message msg;
+	while (CAN.txBufferFree() && _txQueue.Pop(msg))
+	{
+		if (!Load(msg))
+			_txFailed++;
+	}
+}
+
+int MCP2515Controller::Pending()
+{
+	if (_receiveMode == ReceiveMode::Interrupt)
+		return _rxRing.Size();
+
+	return CAN.pendingPackets();
+}
+
+TxStats MCP2515Controller::GetTxStats() const
+{
+	return TxStats{ _txSent, _txFailed, _txQueue.GetOverflowCount(), _txQueue.GetHighWater(), _txQueue.Capacity() };
+}
+
+BusStats MCP2515Controller::GetBusStats()
+{
+	uint8_t tec, rec;
+	uint8_t flags = CAN.readErrors(&tec, &rec);
+
+	// EFLG: TXBO is bit 5, TXEP bit 4, RXEP bit 3
+	BusState state = BusState::Active;
+	if (flags & 0x20)
+		state = BusState::BusOff;
+	else if (flags & 0x18)
+		state = BusState::Passive;
+
+	// The chip keeps no running counts, only the error counters
+	return BusStats{ state, tec, rec, 0, 0, 0 };
+}
+
+RxStats MCP2515Controller::GetRxStats() const
+{
+	if (_receiveMode != ReceiveMode::Interrupt)
+		return CanController::GetRxStats();
+
+	return RxStats{ _rxRing.GetOverflowCount(), _rxRing.GetHighWater(), _rxRing.Capacity() };
 }
 
 }
@@ -3,17 +3,56 @@
 #include "can_wrapper.h"
 #ifdef MCP2515
 #include <CAN.h>
+#include <CommonLib.h>
 
 namespace can
 {
 
+//! Frames held by the interrupt receive queue
+constexpr int RxRingSize = 32;
+
+//! Frames held by the transmit queue while all hardware buffers are busy
+constexpr int TxRingSize = 16;
+
+//! Hardware transmit buffers of the chip
+constexpr int TxBufferCount = 3;
+
+//! Time a frame may wait in a hardware buffer before it is aborted, in milliseconds
+constexpr unsigned long TxTimeoutMs = 100;
+
 class MCP2515Controller : public CanController
 {
+	// Filled by the receive interrupt, the library only accepts a plain function as callback
+	static lib::SpscRing<Message, RxRingSize> _rxRing;
+
+	static void OnReceive(int packetSize);
+
+	//! Read the frame the library has parsed, returns false if it is not an extended frame
+	static bool ReadPacket(Message& msg);
+
+	// Frames waiting for a free hardware buffer, only used from the loop
+	lib::SpscRing<Message, TxRingSize> _txQueue;
+	// Buffers holding a frame, and when each was loaded
+	uint8_t _txLoaded = 0;
+	unsigned long _txLoadedAt[TxBufferCount] = {};
+	uint32_t _txSent = 0;
+	uint32_t _txFailed = 0;
+
+	//! Load a frame into a free hardware buffer, returns false if none is free
+	bool Load(const Message& msg);
+
 public:
 	virtual ~MCP2515Controller() {}
 	bool Start() override;
 	bool Read(Message& msg) override;
+	bool ReadBlocking(Message& msg, unsigned long timeoutMs) override;
 	void Write(Message& mesg) override;
+	bool TxReady() override;
+	void Poll() override;
+	int Pending() override;
+	RxStats GetRxStats() const override;
+	TxStats GetTxStats() const override;
+	BusStats GetBusStats() override;
 };
 
 }
@@ -20,11 +20,77 @@ struct Filter
 	IdType code;
 };
 
+//! Queue size which leaves the controller's own default in place
+constexpr uint16_t DefaultQueueSize = 0;
+
+//! How received frames reach the controller's read functions
+enum class ReceiveMode : uint8_t
+{
+	//! Frames are fetched from the hardware when read
+	Poll,
+	//! Frames are copied into a queue by an interrupt as they arrive
+	Interrupt
+};
+
+//! Counters of the controller's receive queue
+struct RxStats
+{
+	//! Frames dropped because the queue was full
+	uint32_t overflows;
+	//! Most frames ever waiting in the queue
+	int highWater;
+	//! Frames the queue holds, zero if the controller has no queue of its own
+	int capacity;
+};
+
+//! Counters of the controller's transmit path
+struct TxStats
+{
+	//! Frames confirmed on the bus
+	uint32_t sent;
+	//! Frames aborted or rejected by the hardware
+	uint32_t failed;
+	//! Frames dropped because the queue was full
+	uint32_t dropped;
+	//! Most frames ever waiting in the queue
+	int highWater;
+	//! Frames the queue holds, zero if the controller has no queue of its own
+	int capacity;
+};
+
+//! Error state of the controller on the bus
+enum class BusState : uint8_t
+{
+	//! Taking part in the bus normally
+	Active,
+	//! Error counters are high, the controller only sends passive error flags
+	Passive,
+	//! Too many transmit errors, the controller has left the bus
+	BusOff,
+	//! Not started, or the backend cannot tell
+	Unknown
+};
+
+//! Error counters of the controller hardware
+struct BusStats
+{
+	BusState state;
+	//! Transmit and receive error counters kept by the hardware
+	uint8_t txErrors;
+	uint8_t rxErrors;
+	//! Bus errors, lost arbitrations and frames lost by the hardware, zero where not counted
+	uint32_t busErrors;
+	uint32_t arbitrationLost;
+	uint32_t rxMissed;
+};
+
 struct Message
 {
 	IdType id;
 	DataType data[8];
 	int dataSize;
+	//! Time the frame was taken from the hardware in microseconds, set for received frames
+	uint32_t rxMicros;
 };
 
 //! Base class wrapper interface for different CAN libraries
@@ -35,6 +101,9 @@ protected:
 	int _rxPin;
 	Filter _filter;
 	long _clockSpeed;
+	uint16_t _txQueueSize = DefaultQueueSize;
+	uint16_t _rxQueueSize = DefaultQueueSize;
+	ReceiveMode _receiveMode = ReceiveMode::Poll;
 
 public:
 	virtual ~CanController() {}
@@ -45,9 +114,33 @@ public:
 	}
 	void SetClockSpeed(long speed) { _clockSpeed = speed; }
 	void SetFilter(Filter& filter) { _filter = filter; }
-	virtual bool Start();
-	virtual bool Read(Message& msg);
-	virtual void Write(Message& mesg);
+	//! Set sizes of the driver TX and RX queues in frames, must be set before starting
+	void SetQueueSizes(uint16_t txQueue, uint16_t rxQueue)
+	{
+		_txQueueSize = txQueue;
+		_rxQueueSize = rxQueue;
+	}
+	//! Set how received frames are collected, must be set before starting
+	void SetReceiveMode(ReceiveMode mode) { _receiveMode = mode; }
+	virtual bool Start() = 0;
+	//! Read a received frame if one is waiting, never blocks
+	virtual bool Read(Message& msg) = 0;
+	//! Read a received frame, waiting up to the timeout in milliseconds for one to arrive
+	virtual bool ReadBlocking(Message& msg, unsigned long timeoutMs) = 0;
+	//! Queue a frame for sending, never blocks
+	virtual void Write(Message& mesg) = 0;
+	//! Get whether a frame written now goes to the hardware without waiting in a queue
+	virtual bool TxReady() { return true; }
+	//! Collect finished transmissions and move queued frames to the hardware, call regularly
+	virtual void Poll() {}
+	//! Get number of received frames waiting to be read, -1 if unknown
+	virtual int Pending() { return -1; }
+	//! Get receive queue counters
+	virtual RxStats GetRxStats() const { return RxStats{ 0, 0, 0 }; }
+	//! Get transmit counters
+	virtual TxStats GetTxStats() const { return TxStats{ 0, 0, 0, 0, 0 }; }
+	//! Get error counters of the hardware, may talk to the hardware so avoid calling on every loop
+	virtual BusStats GetBusStats() { return BusStats{ BusState::Unknown, 0, 0, 0, 0, 0 }; }
 };
 
 }
\ No newline at end of file
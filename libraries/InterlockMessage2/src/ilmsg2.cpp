@@ -19,6 +19,15 @@ MessageType GetTypeFromId(CAN_IdType id)
 	return (MessageType)num;
 }
 
+#define ILMSG_NAME(msgname, module) \
+	#msgname,
+
+const char* GetMessageTypeName(MessageType type)
+{
+	static const char* const names[] = { ILMSG_MESSAGES(ILMSG_NAME) "Invalid" };
+	return names[type < MessageType::NMessageType ? (int)type : (int)MessageType::NMessageType];
+}
+
 ModuleType GetModTypeFromId(CAN_IdType id)
 {
 	CAN_IdType mask = 0x7F << BitOffset(1);
@@ -46,185 +55,285 @@ void MessageBase::PackMessageId(CAN_Message& msg) const
 	msg.id = ((CAN_IdType)_mt << BitOffset(2)) | ((CAN_IdType)_destid << BitOffset(1)) | (CAN_IdType)_type;
 }
 
-void MessageRegister::PackMessage(CAN_Message& msg) const
+MessageProcessor::MessageProcessor()
 {
-	MessageBase::PackMessage(msg);
-	msg.data[0] = (can::DataType)did;
-	msg.data[1] = (can::DataType)mtype;
+	_moduleNames[(int)ModuleType::All] = "Unspecified";
+	_moduleNames[(int)ModuleType::Core] = "Core";
+	_moduleNames[(int)ModuleType::Lever] = "Lever";
+	_moduleNames[(int)ModuleType::NModuleType] = "Invalid Module Type";
 
-	msg.dataSize = 2;
+	// Lock states hold levers safe and go first, indications only change what the operator sees
+	_sendPriority[(int)MessageType::Init] = SendPriority::Control;
+	_sendPriority[(int)MessageType::Register] = SendPriority::Control;
+	_sendPriority[(int)MessageType::SetLeverState] = SendPriority::Safety;
+	_sendPriority[(int)MessageType::SetLockState] = SendPriority::Safety;
+	_sendPriority[(int)MessageType::SetLockIndication] = SendPriority::Indication;
+	_sendPriority[(int)MessageType::SetModuleLockState] = SendPriority::Safety;
+	_sendPriority[(int)MessageType::Heartbeat] = SendPriority::Control;
 }
 
-bool MessageRegister::UnpackMessage(const CAN_Message& msg)
+void MessageProcessor::RegisterDevice(ModuleType mtype, DeviceId did)
 {
-	if (msg.dataSize != 2)
+	_mtype = mtype;
+	_did = did;
+	SetFilter(mtype, did);
+}
+
+bool MessageProcessor::Start(int txPin, int rxPin, long clockSpeed)
+{
+	if (_controller)
 		return false;
 
-	MessageBase::UnpackMessage(msg);
-	did = (DeviceId)msg.data[0];
-	mtype = (ModuleType)msg.data[1];
+#ifdef ESP32
+	_controller = new can::ESP32Controller();
+#else
+	_controller = new can::MCP2515Controller();
+#endif
 
-	return true;
+	_controller->SetFilter(_filter);
+	_controller->SetPins(txPin, rxPin);
+	_controller->SetQueueSizes(_txQueueSize, _rxQueueSize);
+	_controller->SetReceiveMode(_receiveMode);
+	if (clockSpeed >= 0)
+		_controller->SetClockSpeed(clockSpeed);
+	return _controller->Start();
 }
 
-void MessageSetLeverState::PackMessage(CAN_Message& msg) const
+void MessageProcessor::SetQueueSizes(uint16_t txQueue, uint16_t rxQueue)
 {
-	MessageBase::PackMessage(msg);
-	msg.data[0] = (can::DataType)did;
-	msg.data[1] = (can::DataType)slot;
-	msg.data[2] = (can::DataType)state;
-	msg.data[3] = (can::DataType)faulted;
-
-	msg.dataSize = 4;
+	_txQueueSize = txQueue;
+	_rxQueueSize = rxQueue;
 }
 
-bool MessageSetLeverState::UnpackMessage(const CAN_Message& msg)
+CAN_RxStats MessageProcessor::GetRxStats() const
 {
-	if (msg.dataSize != 4)
-		return false;
+	if (!_controller)
+		return CAN_RxStats{ 0, 0, 0 };
 
-	MessageBase::UnpackMessage(msg);
-	did = (DeviceId)msg.data[0];
-	slot = (SlotId)msg.data[1];
-	state = (LeverState)msg.data[2];
-	faulted = (bool)msg.data[3];
+	return _controller->GetRxStats();
+}
 
-	return true;
+CAN_BusStats MessageProcessor::GetBusStats()
+{
+	if (!_controller)
+		return CAN_BusStats{ CAN_BusState::Unknown, 0, 0, 0, 0, 0 };
+
+	return _controller->GetBusStats();
 }
 
-void MessageSetLockState::PackMessage(CAN_Message& msg) const
+CAN_TxStats MessageProcessor::GetTxStats() const
 {
-	MessageBase::PackMessage(msg);
-	msg.data[0] = (can::DataType)slot;
-	msg.data[1] = (can::DataType)state;
-	msg.data[2] = (can::DataType)locked;
+	if (!_controller)
+		return CAN_TxStats{ 0, 0, 0, 0, 0 };
 
-	msg.dataSize = 3;
+	return _controller->GetTxStats();
 }
 
-bool MessageSetLockState::UnpackMessage(const CAN_Message& msg)
+void MessageProcessor::SetFilter(ModuleType mtype, DeviceId addr)
 {
-	if (msg.dataSize != 3)
-		return false;
+	_filter = GetMsgFilter(mtype, addr);
+}
 
-	MessageBase::UnpackMessage(msg);
-	slot = (SlotId)msg.data[0];
-	state = (LockState)msg.data[1];
-	locked = (bool)msg.data[2];
+#define ILMSG_DISPATCH(msgname, module) \
+	case MessageType::msgname: \
+		valid = Dispatch<Message##msgname>(msg); \
+		break;
 
-	return true;
+void MessageProcessor::ProcessMessage(const CAN_Message& msg)
+{
+	MessageType type = GetTypeFromId(msg.id);
+	if (type >= MessageType::NMessageType)
+	{
+		_stats.rxInvalid++;
+		return;
+	}
+
+	// Every frame is unpacked, so rx and rxInvalid count each frame once
+	bool valid = false;
+	switch (type)
+	{
+		ILMSG_MESSAGES(ILMSG_DISPATCH)
+	default:
+		break;
+	}
+
+	// On receipt of init, return with register
+	if (valid && type == MessageType::Init)
+		SendRegister();
 }
 
-void MessageSetLockIndication::PackMessage(CAN_Message& msg) const
+void MessageProcessor::SendRegister()
 {
-	MessageBase::PackMessage(msg);
-	msg.data[0] = (can::DataType)showIndication;
+	if (_did < 0)
+		return;
+
+	MessageRegister msg = {};
+	msg.mtype = _mtype;
+	msg.did = _did;
 
-	msg.dataSize = 1;
+	SendMessage(msg);
 }
 
-bool MessageSetLockIndication::UnpackMessage(const CAN_Message& msg)
+void MessageProcessor::SendHeartbeat()
 {
-	if (msg.dataSize != 1)
-		return false;
+	if (_did < 0)
+		return;
 
-	MessageBase::UnpackMessage(msg);
-	showIndication = (bool)msg.data[0];
+	MessageHeartbeat msg = {};
+	msg.did = _did;
 
-	return true;
+	SendMessage(msg);
 }
 
-MessageProcessor::MessageProcessor()
+bool MessageProcessor::AddHandler(MessageType type, const MessageHandler& handler)
 {
-	_moduleNames[(int)ModuleType::All] = "Unspecified";
-	_moduleNames[(int)ModuleType::Core] = "Core";
-	_moduleNames[(int)ModuleType::Lever] = "Lever";
-	_moduleNames[(int)ModuleType::NModuleType] = "Invalid Module Type";
+	int idx = (int)type;
+	if (_handlerCount[idx] >= MaxMessageHandlers)
+		return false;
+
+	_handlers[idx][_handlerCount[idx]++] = handler;
+	return true;
 }
 
-void MessageProcessor::RegisterDevice(ModuleType mtype, DeviceId did)
+void MessageProcessor::SetReceiveBatch(int maxMessages, unsigned long budgetMicros)
 {
-	_mtype = mtype;
-	_did = did;
-	SetFilter(mtype, did);
+	_receiveBatch = maxMessages > 0 ? maxMessages : 1;
+	_receiveBudget = budgetMicros;
 }
 
-bool MessageProcessor::Start(int txPin, int rxPin, long clockSpeed)
+ReceiveResult MessageProcessor::ProcessReceived()
 {
-	if (_controller)
-		return false;
+	ReceiveResult result;
+	if (!_controller)
+		return result;
 
-#ifdef ESP32
-	_controller = new can::ESP32Controller();
-#else
-	_controller = new can::MCP2515Controller();
-#endif
+	// Finished transmissions free buffers for queued messages
+	FlushSend();
 
-	_controller->SetFilter(_filter);
-	_controller->SetPins(txPin, rxPin);
-	if (clockSpeed >= 0)
-		_controller->SetClockSpeed(clockSpeed);
-	return _controller->Start();
+	// Always process at least one message, so a small budget cannot stall the bus
+	unsigned long start = micros();
+	bool drained = false;
+	while (result.processed < _receiveBatch)
+	{
+		if (result.processed > 0 && _receiveBudget > 0 && micros() - start >= _receiveBudget)
+			break;
+
+		CAN_Message msg = {};
+		if (!_controller->Read(msg))
+		{
+			drained = true;
+			break;
+		}
+
+		uint32_t latency = (uint32_t)micros() - msg.rxMicros;
+		_stats.latency[LatencyBucket(latency)]++;
+		if (latency > _stats.latencyMax)
+			_stats.latencyMax = latency;
+
+		ProcessMessage(msg);
+		result.processed++;
+	}
+
+	// Only ask the controller what is left when the batch stopped early
+	result.pending = drained ? 0 : _controller->Pending();
+	return result;
 }
 
-void MessageProcessor::SetFilter(ModuleType mtype, DeviceId addr)
+void MessageProcessor::SendMessage(const MessageBase& msg)
 {
-	_filter = GetMsgFilter(mtype, addr);
-}
+	if (!_controller)
+		return;
 
-#define INVOKE_MSG(msgname) \
-	case MessageType::msgname: \
-		InvokeProcessFunc<Message##msgname>(type, msg); \
-		break;
+	QueuedMessage entry = {};
+	msg.PackMessage(entry.msg);
+	entry.key = msg.GetSendKey();
+	entry.seq = _sendSeq++;
+	entry.priority = _sendPriority[(int)msg.GetType()];
 
-void MessageProcessor::ProcessMessage(const CAN_Message& msg)
-{
-	MessageType type = GetTypeFromId(msg.id);
-	switch (type)
+	// A newer state for the same key replaces the queued one, keeping its place in the queue
+	if (entry.key != NoSendKey)
 	{
-		INVOKE_MSG(Init)
-		INVOKE_MSG(Register)
-		INVOKE_MSG(SetLeverState)
-		INVOKE_MSG(SetLockState)
-		INVOKE_MSG(SetLockIndication)
+		for (int i = 0; i < _sendCount; i++)
+		{
+			QueuedMessage& queued = _sendQueue[i];
+			if (queued.key == entry.key && queued.msg.id == entry.msg.id)
+			{
+				queued.msg = entry.msg;
+				queued.priority = entry.priority;
+				_sendStats.replaced++;
+				FlushSend();
+				return;
+			}
+		}
 	}
 
-	// On receipt of init, return with register
-	if (type == MessageType::Init && _did >= 0)
+	if (_sendCount == SendQueueSize)
 	{
-		MessageRegister msg = {};
-		msg.mtype = _mtype;
-		msg.did = _did;
+		// Make room by dropping the newest message of the lowest priority, if it is below this one
+		int victim = -1;
+		for (int i = 0; i < _sendCount; i++)
+		{
+			const QueuedMessage& queued = _sendQueue[i];
+			if (queued.priority <= entry.priority)
+				continue;
+			if (victim < 0 || queued.priority > _sendQueue[victim].priority ||
+				(queued.priority == _sendQueue[victim].priority && queued.seq > _sendQueue[victim].seq))
+				victim = i;
+		}
+
+		_sendStats.dropped++;
+		if (victim < 0)
+			return;
+		RemoveQueued(victim);
+	}
 
-		SendMessage(msg);
+	_sendQueue[_sendCount++] = entry;
+	if (_sendCount > _sendStats.highWater)
+		_sendStats.highWater = _sendCount;
+
+	FlushSend();
+}
+
+int MessageProcessor::NextQueued() const
+{
+	int next = -1;
+	for (int i = 0; i < _sendCount; i++)
+	{
+		const QueuedMessage& queued = _sendQueue[i];
+		if (next < 0 || queued.priority < _sendQueue[next].priority ||
+			(queued.priority == _sendQueue[next].priority && queued.seq < _sendQueue[next].seq))
+			next = i;
 	}
+	return next;
 }
 
-void MessageProcessor::OnMessage(MessageType type, MessageProcessFuncBase* func)
+void MessageProcessor::RemoveQueued(int idx)
 {
-	_processEvents.insert(std::make_pair(type, func));
+	_sendQueue[idx] = _sendQueue[--_sendCount];
 }
 
-void MessageProcessor::ProcessReceived()
+void MessageProcessor::FlushSend()
 {
 	if (!_controller)
 		return;
 
-	CAN_Message msg = {};
-	if (_controller->Read(msg))
+	_controller->Poll();
+
+	// Only hand over what goes straight to the hardware, the rest stays here where it can still be replaced
+	while (_sendCount > 0 && _controller->TxReady())
 	{
-		ProcessMessage(msg);
+		int next = NextQueued();
+		_controller->Write(_sendQueue[next].msg);
+		_stats.tx[(int)GetTypeFromId(_sendQueue[next].msg.id)]++;
+		RemoveQueued(next);
 	}
 }
 
-void MessageProcessor::SendMessage(const MessageBase& msg)
+SendQueueStats MessageProcessor::GetSendQueueStats() const
 {
-	if (!_controller)
-		return;
-
-	CAN_Message cmsg = {};
-	msg.PackMessage(cmsg);
-	_controller->Write(cmsg);
+	SendQueueStats stats = _sendStats;
+	stats.depth = _sendCount;
+	return stats;
 }
 
 // Processor instance
@@ -19,10 +19,34 @@ using CAN_DataType = can::DataType;
 using CAN_Filter = can::Filter;
 using CAN_Message = can::Message;
 using CAN_Controller = can::CanController;
+using CAN_ReceiveMode = can::ReceiveMode;
+using CAN_RxStats = can::RxStats;
+using CAN_TxStats = can::TxStats;
+using CAN_BusStats = can::BusStats;
+using CAN_BusState = can::BusState;
 
 typedef byte DeviceId;
 typedef byte SlotId;
 
+//! Default most messages processed by one call to ProcessReceived
+constexpr int DefaultReceiveBatch = 16;
+//! Default time budget of one call to ProcessReceived in microseconds
+constexpr unsigned long DefaultReceiveBudget = 2000;
+//! Messages held by the send queue while the controller is busy
+constexpr int SendQueueSize = 32;
+//! Send key of a message which is never replaced in the send queue
+constexpr int NoSendKey = -1;
+//! Most slots carried by one module lock state message
+constexpr int ModuleLockSlots = 8;
+//! Most handlers registered for one message type
+constexpr int MaxMessageHandlers = 4;
+//! Buckets of the receive latency histogram, each twice as wide as the one before
+constexpr int LatencyBuckets = 12;
+//! Upper bound of the first latency bucket in microseconds
+constexpr uint32_t LatencyBucketBase = 64;
+//! Time between heartbeats sent by a module in milliseconds
+constexpr unsigned long HeartbeatInterval = 250;
+
 enum class ModuleType : byte
 {
 	All = 0,
@@ -31,19 +55,169 @@ enum class ModuleType : byte
 	NModuleType
 };
 
+//! Version of the message schema, sent as the first byte of every message. Bump it whenever
+//! a field list below changes, older devices then ignore the new frames.
+constexpr byte SchemaVersion = 1;
+
+// Message schema. Each message lists its fields as FIELD(name, type, bits), packed in order
+// after the version byte. Bools and enums take only the bits given here.
+#define ILMSG_FIELDS_Init(FIELD)
+
+#define ILMSG_FIELDS_Register(FIELD) \
+	FIELD(did, DeviceId, 8) \
+	FIELD(mtype, ModuleType, 7)
+
+#define ILMSG_FIELDS_SetLeverState(FIELD) \
+	FIELD(did, DeviceId, 8) \
+	FIELD(slot, SlotId, 8) \
+	FIELD(state, LeverState, 1) \
+	FIELD(faulted, bool, 1)
+
+#define ILMSG_FIELDS_SetLockState(FIELD) \
+	FIELD(slot, SlotId, 8) \
+	FIELD(state, LockState, 1) \
+	FIELD(locked, bool, 1)
+
+#define ILMSG_FIELDS_SetLockIndication(FIELD) \
+	FIELD(showIndication, bool, 1)
+
+#define ILMSG_FIELDS_SetModuleLockState(FIELD) \
+	FIELD(slots, byte, ModuleLockSlots) \
+	FIELD(states, byte, ModuleLockSlots) \
+	FIELD(locked, byte, ModuleLockSlots)
+
+#define ILMSG_FIELDS_Heartbeat(FIELD) \
+	FIELD(did, DeviceId, 8)
+
+// All messages as MSG(name, destination module type), in order of their MessageType
+#define ILMSG_MESSAGES(MSG) \
+	MSG(Init, All) \
+	MSG(Register, Core) \
+	MSG(SetLeverState, Core) \
+	MSG(SetLockState, Lever) \
+	MSG(SetLockIndication, Lever) \
+	MSG(SetModuleLockState, Lever) \
+	MSG(Heartbeat, Core)
+
+#define ILMSG_ENUM(msgname, module) \
+	msgname,
+
 enum class MessageType : byte
 {
-	Init,
-	Register,
-	SetLeverState,
-	SetLockState,
-	SetLockIndication
+	ILMSG_MESSAGES(ILMSG_ENUM)
+	NMessageType
+};
+
+//! Order in which queued messages are sent, lower values go first
+enum class SendPriority : byte
+{
+	Safety,
+	Control,
+	Indication
 };
 
 MessageType GetTypeFromId(CAN_IdType id);
 
+//! Get name of a message type
+const char* GetMessageTypeName(MessageType type);
+
 CAN_Filter GetMsgFilter(ModuleType modType, DeviceId address);
 
+namespace codec
+{
+
+//! Bit offset of a field, the sum of the widths of the fields before it after the version byte
+constexpr int FieldOffset(const byte* widths, int idx)
+{
+	return idx == 0 ? 8 : FieldOffset(widths, idx - 1) + widths[idx - 1];
+}
+
+//! Field of the given width at a fixed bit offset in a payload, least significant bit first.
+//! Offsets and widths are template arguments so each access reduces to a few shifts and masks.
+template <int Bit, int Bits>
+struct BitField
+{
+	constexpr static int Shift = Bit & 7;
+	constexpr static int Take = 8 - Shift < Bits ? 8 - Shift : Bits;
+	typedef BitField<Bit + Take, Bits - Take> Rest;
+
+	//! Write the low bits of value, the bits must be clear
+	static void Write(CAN_DataType* data, uint32_t value)
+	{
+		data[Bit >> 3] |= (CAN_DataType)((value & ((1u << Take) - 1)) << Shift);
+		Rest::Write(data, value >> Take);
+	}
+
+	//! Read the field
+	static uint32_t Read(const CAN_DataType* data)
+	{
+		return ((uint32_t)(data[Bit >> 3] >> Shift) & ((1u << Take) - 1)) | (Rest::Read(data) << Take);
+	}
+};
+
+template <int Bit>
+struct BitField<Bit, 0>
+{
+	static void Write(CAN_DataType*, uint32_t) {}
+	static uint32_t Read(const CAN_DataType*) { return 0; }
+};
+
+} // namespace codec
+
+#define ILMSG_FIELD_INDEX(name, type, bits) \
+	Field_##name,
+
+#define ILMSG_FIELD_WIDTH(name, type, bits) \
+	bits,
+
+#define ILMSG_FIELD_MEMBER(name, type, bits) \
+	type name = type();
+
+#define ILMSG_FIELD_CHECK(name, type, bits) \
+	static_assert((bits) > 0 && (bits) <= 32 && (bits) <= (int)sizeof(type) * 8, "field " #name " has an invalid bit width");
+
+#define ILMSG_FIELD_PACK(name, type, bits) \
+	codec::BitField<codec::FieldOffset(FieldBits, Field_##name), bits>::Write(data, (uint32_t)name);
+
+#define ILMSG_FIELD_UNPACK(name, type, bits) \
+	name = (type)codec::BitField<codec::FieldOffset(FieldBits, Field_##name), bits>::Read(msg.data);
+
+//! Generate the fields, constructor and codec of a message from its schema entry. Pack and
+//! Unpack are not virtual, the virtual PackMessage and UnpackMessage forward to them.
+#define ILMSG_MESSAGE(msgname, module) \
+	enum FieldIndex : int { ILMSG_FIELDS_##msgname(ILMSG_FIELD_INDEX) FieldCount }; \
+	constexpr static byte FieldBits[FieldCount + 1] = { ILMSG_FIELDS_##msgname(ILMSG_FIELD_WIDTH) 0 }; \
+	\
+public: \
+	ILMSG_FIELDS_##msgname(ILMSG_FIELD_MEMBER) \
+	constexpr static MessageType Type = MessageType::msgname; \
+	constexpr static int PayloadBits = codec::FieldOffset(FieldBits, FieldCount) - 8; \
+	constexpr static int DataSize = 1 + (PayloadBits + 7) / 8; \
+	static_assert(DataSize <= 8, "Message" #msgname " does not fit in a CAN frame"); \
+	ILMSG_FIELDS_##msgname(ILMSG_FIELD_CHECK) \
+	\
+	Message##msgname() : MessageBase(Type, ModuleType::module) {} \
+	virtual ~Message##msgname() {} \
+	\
+	void Pack(CAN_Message& msg) const \
+	{ \
+		/* Assemble in a local so the fields combine in registers before one store each */ \
+		CAN_DataType data[DataSize] = { SchemaVersion }; \
+		ILMSG_FIELDS_##msgname(ILMSG_FIELD_PACK) \
+		PackMessageId(msg); \
+		for (int i = 0; i < DataSize; i++) \
+			msg.data[i] = data[i]; \
+		msg.dataSize = DataSize; \
+	} \
+	bool Unpack(const CAN_Message& msg) \
+	{ \
+		if (msg.dataSize != DataSize || msg.data[0] != SchemaVersion) \
+			return false; \
+		ILMSG_FIELDS_##msgname(ILMSG_FIELD_UNPACK) \
+		return true; \
+	} \
+	void PackMessage(CAN_Message& msg) const override { Pack(msg); } \
+	bool UnpackMessage(const CAN_Message& msg) override { return Unpack(msg); }
 
 // Message classes
 class MessageBase
@@ -53,155 +227,317 @@ class MessageBase
 	MessageType _type;
 
 protected:
-	MessageBase(MessageType type, ModuleType mt) : _type(type), _mt(mt) {}
+	MessageBase(MessageType type, ModuleType mt) : _mt(mt), _type(type) {}
 	void PackMessageId(CAN_Message& msg) const;
 
 public:
 	virtual ~MessageBase() {}
-	virtual void PackMessage(CAN_Message& msg) const { PackMessageId(msg); }
-	virtual bool UnpackMessage(const CAN_Message& msg) 
-	{
-		_type = GetTypeFromId(msg.id);
-		return false;
-	}
+	virtual void PackMessage(CAN_Message& msg) const = 0;
+	virtual bool UnpackMessage(const CAN_Message& msg) = 0;
 
 	//! Set destination ID
 	void SetDestination(DeviceId did)
 	{
 		_destid = did;
 	}
+
+	//! Get message type
+	MessageType GetType() const { return _type; }
+
+	//! Get key of the state this message carries within its destination and type. A queued
+	//! message with the same key is replaced by a newer one, NoSendKey is never replaced.
+	virtual int GetSendKey() const { return NoSendKey; }
 };
 
-class MessageInit: public MessageBase
+class MessageInit : public MessageBase
 {
-public:
-	virtual ~MessageInit() {}
-	MessageInit() : MessageBase(MessageType::Init, ModuleType::All) {}
+	ILMSG_MESSAGE(Init, All)
 };
 
 class MessageRegister : public MessageBase
 {
-public:
-	ModuleType mtype;
-	DeviceId did = 0;
-
-	virtual ~MessageRegister() {}
-	MessageRegister() : MessageBase(MessageType::Register, ModuleType::Core) {}
-	void PackMessage(CAN_Message& msg) const override;
-	bool UnpackMessage(const CAN_Message& msg) override;
+	ILMSG_MESSAGE(Register, Core)
 };
 
-
 class MessageSetLeverState : public MessageBase
 {
-public:
-	DeviceId did = 0;
-	SlotId slot = 0;
-	LeverState state = LeverState::Normal;
-	bool faulted = false;
+	ILMSG_MESSAGE(SetLeverState, Core)
 
-	virtual ~MessageSetLeverState() {}
-	MessageSetLeverState() : MessageBase(MessageType::SetLeverState, ModuleType::Core) {}
-	void PackMessage(CAN_Message& msg) const override;
-	bool UnpackMessage(const CAN_Message& msg) override;
+	int GetSendKey() const override { return ((int)did << 8) | slot; }
 };
 
 class MessageSetLockState : public MessageBase
 {
-public:
-	SlotId slot = 0;
-	LockState state = LockState::On;
-	bool locked = false;
+	ILMSG_MESSAGE(SetLockState, Lever)
 
-	virtual ~MessageSetLockState() {}
-	MessageSetLockState() : MessageBase(MessageType::SetLockState, ModuleType::Lever) {}
-	void PackMessage(CAN_Message& msg) const override;
-	bool UnpackMessage(const CAN_Message& msg) override;
+	int GetSendKey() const override { return slot; }
 };
 
 class MessageSetLockIndication : public MessageBase
 {
-public:
-	bool showIndication = false;
+	ILMSG_MESSAGE(SetLockIndication, Lever)
 
-	virtual ~MessageSetLockIndication() {}
-	MessageSetLockIndication() : MessageBase(MessageType::SetLockIndication, ModuleType::Lever) {}
-	void PackMessage(CAN_Message& msg) const override;
-	bool UnpackMessage(const CAN_Message& msg) override;
+	int GetSendKey() const override { return 0; }
 };
 
-//! Base class for a message process callback function
-class MessageProcessFuncBase
+//! Lock state of every slot of one lever module in a single frame, one bit per slot.
+//! States are set for LockState::Off.
+class MessageSetModuleLockState : public MessageBase
 {
-public:
-	virtual ~MessageProcessFuncBase() {}
+	ILMSG_MESSAGE(SetModuleLockState, Lever)
+
+	int GetSendKey() const override { return 0; }
+
+	//! Set the state of a slot, slot must be less than ModuleLockSlots
+	void SetSlot(SlotId slot, LockState state, bool isLocked)
+	{
+		byte bit = 1 << slot;
+		slots |= bit;
+		states = state == LockState::Off ? (states | bit) : (states & ~bit);
+		locked = isLocked ? (locked | bit) : (locked & ~bit);
+	}
+
+	//! Get whether the message carries the slot
+	bool HasSlot(SlotId slot) const { return slot < ModuleLockSlots && (slots & (1 << slot)); }
+
+	//! Get lock state of a slot
+	LockState GetState(SlotId slot) const { return (states & (1 << slot)) ? LockState::Off : LockState::On; }
+
+	//! Get whether a slot is locked
+	bool IsLocked(SlotId slot) const { return locked & (1 << slot); }
 };
 
-//! Template class to create a message process callback for specified message type
-template <class T>
-class MessageProcessFunc : public MessageProcessFuncBase
+//! Sent by a module every HeartbeatInterval so the core knows it is still on the bus
+class MessageHeartbeat : public MessageBase
 {
-	void (*_func)(T);
-public:
-	MessageProcessFunc<T>(void (*func)(T)) :
-		_func(func)
-	{}
-	virtual ~MessageProcessFunc<T>() {}
+	ILMSG_MESSAGE(Heartbeat, Core)
+
+	int GetSendKey() const override { return did; }
+};
+
+//! Callback for a received message, a free function or a member function bound to its object.
+//! Holds only plain pointers, so handlers are stored in place without allocation.
+struct MessageHandler
+{
+	typedef void (*Thunk)(const MessageHandler& handler, const MessageBase& msg);
+	typedef void (*FuncPtr)();
 
-	//! Invoke the callback function
-	void InvokeFunc(T msg)
+	Thunk thunk = nullptr;
+	void* object = nullptr;
+	FuncPtr func = nullptr;
+
+	//! Call a free function, restoring its type
+	template <class T>
+	static void InvokeFunc(const MessageHandler& handler, const MessageBase& msg)
+	{
+		reinterpret_cast<void (*)(const T&)>(handler.func)(static_cast<const T&>(msg));
+	}
+
+	//! Call a member function on the bound object
+	template <class T, class C, void (C::*Method)(const T&)>
+	static void InvokeMember(const MessageHandler& handler, const MessageBase& msg)
 	{
-		_func(msg);
+		(static_cast<C*>(handler.object)->*Method)(static_cast<const T&>(msg));
 	}
 };
 
+//! Outcome of one call to process received messages
+struct ReceiveResult
+{
+	//! Number of messages read and processed
+	int processed = 0;
+	//! Number of messages still waiting in the controller, -1 if unknown
+	int pending = 0;
+};
+
+//! Counters of the processor's send queue
+struct SendQueueStats
+{
+	//! Messages waiting in the queue
+	int depth = 0;
+	//! Most messages ever waiting in the queue
+	int highWater = 0;
+	//! Messages the queue holds
+	int capacity = SendQueueSize;
+	//! Queued messages replaced by a newer message with the same key
+	uint32_t replaced = 0;
+	//! Messages dropped because the queue was full
+	uint32_t dropped = 0;
+};
+
+//! Message counters of the processor
+struct MessageStats
+{
+	//! Messages of each type received and unpacked, and handed to the controller to send
+	uint32_t rx[(int)MessageType::NMessageType];
+	uint32_t tx[(int)MessageType::NMessageType];
+	//! Received frames of an unknown type or which failed to unpack
+	uint32_t rxInvalid;
+	//! Time from taking a frame from the hardware to dispatching it. Bucket 0 counts latencies
+	//! below LatencyBucketBase microseconds, each further bucket up to twice the previous bound
+	//! and the last bucket everything above.
+	uint32_t latency[LatencyBuckets];
+	//! Longest latency seen in microseconds
+	uint32_t latencyMax;
+};
+
+//! Get the latency histogram bucket of a latency in microseconds
+inline int LatencyBucket(uint32_t micros)
+{
+	int bucket = 0;
+	for (uint32_t scaled = micros / LatencyBucketBase; scaled > 0 && bucket < LatencyBuckets - 1; scaled >>= 1)
+		bucket++;
+	return bucket;
+}
+
 class MessageProcessor
 {
+	//! Packed message waiting to be written to the controller
+	struct QueuedMessage
+	{
+		CAN_Message msg;
+		int key;
+		uint32_t seq;
+		SendPriority priority;
+	};
+
 	ModuleType _mtype;
 	DeviceId _did = -1;
-	Map<MessageType, MessageProcessFuncBase*> _processEvents;
+	// Handlers of each message type, in the order they were registered
+	MessageHandler _handlers[(int)MessageType::NMessageType][MaxMessageHandlers];
+	byte _handlerCount[(int)MessageType::NMessageType] = {};
 	CAN_Filter _filter;
 	CAN_Controller* _controller = nullptr;
-	String _moduleNames[(int)ModuleType::NModuleType];
-
-	//! Template function for invoking message processor function callback
+	// Names of each module type, with a final entry for invalid types
+	String _moduleNames[(int)ModuleType::NModuleType + 1];
+	int _receiveBatch = DefaultReceiveBatch;
+	unsigned long _receiveBudget = DefaultReceiveBudget;
+	uint16_t _txQueueSize = can::DefaultQueueSize;
+	uint16_t _rxQueueSize = can::DefaultQueueSize;
+	CAN_ReceiveMode _receiveMode = CAN_ReceiveMode::Poll;
+
+	// Send queue, unordered; messages go out by priority, then in the order they were queued
+	QueuedMessage _sendQueue[SendQueueSize];
+	int _sendCount = 0;
+	uint32_t _sendSeq = 0;
+	SendPriority _sendPriority[(int)MessageType::NMessageType];
+	SendQueueStats _sendStats;
+	MessageStats _stats = {};
+
+	//! Unpack a message once and pass it to every handler of its type, returns false if it failed to unpack
 	template <class T>
-	void InvokeProcessFunc(MessageType type, CAN_Message msg)
+	bool Dispatch(const CAN_Message& msg)
 	{
-		if (_processEvents.find(type) != _processEvents.end())
+		int type = (int)T::Type;
+		T unpackedMsg;
+		if (!unpackedMsg.Unpack(msg))
 		{
-			T unpackedMsg = T();
-			if (unpackedMsg.UnpackMessage(msg))
-			{
-				MessageProcessFunc<T>* func = static_cast<MessageProcessFunc<T>*>(_processEvents.at(type));
-				func->InvokeFunc(unpackedMsg);
-			}
+			_stats.rxInvalid++;
+			return false;
 		}
+		_stats.rx[type]++;
+
+		for (int i = 0; i < _handlerCount[type]; i++)
+		{
+			const MessageHandler& handler = _handlers[type][i];
+			handler.thunk(handler, unpackedMsg);
+		}
+		return true;
 	}
+
+	//! Add a handler for a message type, returns false if the type has no room left
+	bool AddHandler(MessageType type, const MessageHandler& handler);
+
 	//! Process a CAN message
 	void ProcessMessage(const CAN_Message& msg);
 
+	//! Find the queued message to send next, -1 if the queue is empty
+	int NextQueued() const;
+
+	//! Remove a message from the send queue
+	void RemoveQueued(int idx);
+
 public:
 	MessageProcessor();
 
 	//! Set the ID of this device
 	void RegisterDevice(ModuleType mtype, DeviceId did);
 
+	//! Announce this device to the core, sent on start so a module that resets is known again
+	void SendRegister();
+
+	//! Send a heartbeat from this device, call every HeartbeatInterval
+	void SendHeartbeat();
+
 	//! Start processor and open CAN connection
 	bool Start(int txPin, int rxPin, long clockSpeed = -1);
 
+	//! Set sizes of the CAN driver TX and RX queues in frames, must be set before starting
+	void SetQueueSizes(uint16_t txQueue, uint16_t rxQueue);
+
+	//! Set how the CAN controller collects received frames, must be set before starting
+	void SetReceiveMode(CAN_ReceiveMode mode) { _receiveMode = mode; }
+
+	//! Get receive queue counters of the CAN controller
+	CAN_RxStats GetRxStats() const;
+
+	//! Get transmit counters of the CAN controller
+	CAN_TxStats GetTxStats() const;
+
 	//! Set filter
 	void SetFilter(ModuleType mtype, DeviceId addr);
 
-	//! Register a callback for when a specific message is processed
-	void OnMessage(MessageType type, MessageProcessFuncBase* func);
+	//! Register a function called with each processed message of type T, returns false if
+	//! MaxMessageHandlers are already registered for the type
+	template <class T>
+	bool OnMessage(void (*func)(const T&))
+	{
+		MessageHandler handler;
+		handler.thunk = &MessageHandler::InvokeFunc<T>;
+		handler.func = reinterpret_cast<MessageHandler::FuncPtr>(func);
+		return AddHandler(T::Type, handler);
+	}
+
+	//! Register a member function of object called with each processed message of type T,
+	//! returns false if MaxMessageHandlers are already registered for the type
+	template <class T, class C, void (C::*Method)(const T&)>
+	bool OnMessage(C* object)
+	{
+		MessageHandler handler;
+		handler.thunk = &MessageHandler::InvokeMember<T, C, Method>;
+		handler.object = object;
+		return AddHandler(T::Type, handler);
+	}
+
+	//! Set the most messages processed by one call to ProcessReceived, and its time budget
+	//! in microseconds. A budget of zero only limits the number of messages.
+	void SetReceiveBatch(int maxMessages, unsigned long budgetMicros = 0);
 
-	//! Process any received messages
-	void ProcessReceived();
+	//! Process received messages until none are left, the batch is full or the time budget runs out
+	ReceiveResult ProcessReceived();
 
-	//! Send a message over the bus
+	//! Queue a message to be sent over the bus, replacing a queued message with the same destination,
+	//! type and send key, and write as much of the queue to the controller as it accepts
 	void SendMessage(const MessageBase& msg);
 
+	//! Write queued messages to the controller while it can put them straight on the bus
+	void FlushSend();
+
+	//! Set the send priority of a message type
+	void SetSendPriority(MessageType type, SendPriority priority) { _sendPriority[(int)type] = priority; }
+
+	//! Get send queue counters
+	SendQueueStats GetSendQueueStats() const;
+
+	//! Get message counters and the receive latency histogram
+	const MessageStats& GetMessageStats() const { return _stats; }
+
+	//! Clear message counters and the latency histogram
+	void ResetMessageStats() { _stats = {}; }
+
+	//! Get error counters of the CAN hardware, talks to the hardware on some backends
+	CAN_BusStats GetBusStats();
+
 	//! Get module type name;
 	String ModuleTypeToString(ModuleType mtype) { return _moduleNames[(int)mtype]; }
 };
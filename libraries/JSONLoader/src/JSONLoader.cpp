@@ -34,6 +34,24 @@ JSONLoader::JSONLoader(DynamicJsonDocument& doc)
 			_interlockingData.push_back(data);
 		}
 	}
+
+	// Load optional route data into vector
+	_routeData = {};
+	JsonArray routes = doc["Routes"];
+	for (JsonObject route : routes)
+	{
+		RouteData data = {};
+		data.name = route["Name"].as<String>();
+		for (String leverName : route["Reversed"].as<JsonArray>())
+		{
+			data.reversed.push_back(leverName);
+		}
+		for (String leverName : route["Normal"].as<JsonArray>())
+		{
+			data.normal.push_back(leverName);
+		}
+		_routeData.push_back(data);
+	}
 }
 
 LockingRule JSONLoader::LockingRuleFromString(const String& str)
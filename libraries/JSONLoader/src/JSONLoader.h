@@ -33,10 +33,18 @@ struct InterlockingData
 	LockingRule ruleOff;
 };
 
+struct RouteData
+{
+	String name;
+	Vector<String> reversed;
+	Vector<String> normal;
+};
+
 class JSONLoader
 {
 	Vector<LeverData> _leverData;
 	Vector<InterlockingData> _interlockingData;
+	Vector<RouteData> _routeData;
 public:
 	JSONLoader(DynamicJsonDocument& doc);
 
@@ -46,6 +54,9 @@ public:
 	//! Get Interlocking Data
 	const Vector<InterlockingData>& GetInterlockingData() { return _interlockingData; }
 
+	//! Get Route Data, empty if the config has no routes
+	const Vector<RouteData>& GetRouteData() { return _routeData; }
+
 private:
 	LockingRule LockingRuleFromString(const String& str);
 };
@@ -3,88 +3,328 @@
 * Author: Kyle Sarnik
 **/
 
-#include "LeverCom2.h"
+#include "levercom2.h"
 
 namespace levercom
 {
 
-void LeverComManager::ManagerOnSetLeverState(ilmsg::MessageSetLeverState msg)
+LeverComManager::LeverComManager()
 {
-	LeverManager.OnSetLeverState(msg);
+	for (int i = 0; i <= lib::MaxModuleAddr; i++)
+	{
+		_moduleRows[i] = NoModule;
+		_deviceIndex[i] = NoModule;
+	}
+
+	for (int i = 0; i < WheelSlots; i++)
+		_wheel[i] = NoModule;
 }
 
-void LeverComManager::RegisterLever(DeviceSlot dSlot, LockingId lid, bool locked)
+bool LeverComManager::RegisterLever(DeviceSlot dSlot, LockingId lid, bool locked)
 {
-	LeverInfo* info = new LeverInfo();
-	info->lid = lid;
-	info->leverLocked = locked;
-	_info.insert(std::make_pair(dSlot, info));
-	_slotMap.insert(std::make_pair(lid, dSlot));
+	if (dSlot.address > lib::MaxModuleAddr || dSlot.slot >= SlotsPerModule || lid == ilock::Interlocking::faultLockId)
+		return false;
+
+	// Add a row the first time a module is seen, the table only grows while setting up
+	if (_moduleRows[dSlot.address] == NoModule)
+	{
+		if (_modules.size() >= NoModule)
+			return false;
+
+		_moduleRows[dSlot.address] = (byte)_modules.size();
+		_modules.push_back(ModuleRow{ dSlot.address, false, false, false, false, NoModule });
+		_info.resize(_modules.size() * SlotsPerModule);
+	}
+
+	uint16_t idx = _moduleRows[dSlot.address] * SlotsPerModule + dSlot.slot;
+	LeverInfo& info = _info[idx];
+	if (info.lid != ilock::Interlocking::faultLockId)
+		return false;
+
+	info.lid = lid;
+	info.lockState = LockState::On;
+	info.currentState = LeverState::Normal;
+	info.leverLocked = locked;
+
+	if (lid >= _leverIndex.size())
+		_leverIndex.resize(lid + 1, NoIndex);
+	_leverIndex[lid] = idx;
+	return true;
 }
 
-void LeverComManager::SendLockState(DeviceSlot dSlot)
+void LeverComManager::SendLockState(uint16_t idx)
 {
-	if (_info.find(dSlot) == _info.end())
-		return;
+	const LeverInfo& info = _info[idx];
+	DeviceSlot dSlot = GetDeviceSlot(idx);
 
 	ilmsg::MessageSetLockState msg = {};
 	msg.slot = dSlot.slot;
-	msg.state = _info[dSlot]->lockState;
-	msg.locked = _info[dSlot]->leverLocked;
+	msg.state = info.lockState;
+	msg.locked = info.leverLocked;
 	msg.SetDestination(dSlot.address);
 	ilmsg::Processor.SendMessage(msg);
 }
 
-void LeverComManager::OnRegister(ilmsg::MessageRegister msg)
+void LeverComManager::UpdateLockState(uint16_t idx)
 {
-	_registeredDevices.push_back(msg.did);
+	if (_lockSendMode == LockSendMode::PerSlot)
+	{
+		SendLockState(idx);
+		return;
+	}
+
+	byte row = idx / SlotsPerModule;
+	if (!_modules[row].dirty)
+	{
+		_modules[row].dirty = true;
+		_dirtyModules.push_back(row);
+	}
 }
 
-void LeverComManager::OnSetLeverState(ilmsg::MessageSetLeverState msg)
+void LeverComManager::SendModuleLockState(byte row)
 {
-	DeviceSlot dSlot = { msg.did, msg.slot };
+	ilmsg::MessageSetModuleLockState msg = {};
+	const LeverInfo* info = &_info[row * SlotsPerModule];
+	for (int slot = 0; slot < SlotsPerModule; slot++)
+	{
+		if (info[slot].lid != ilock::Interlocking::faultLockId)
+			msg.SetSlot(slot, info[slot].lockState, info[slot].leverLocked);
+	}
 
-	if (_info.find(dSlot) == _info.end())
+	if (msg.slots == 0)
 		return;
 
-	if (msg.state != _info[dSlot]->currentState)
+	msg.SetDestination(_modules[row].address);
+	ilmsg::Processor.SendMessage(msg);
+}
+
+void LeverComManager::SendResync(byte row)
+{
+	SendModuleLockState(row);
+
+	ilmsg::MessageSetLockIndication msg = {};
+	msg.showIndication = _indicateLeverLocks;
+	msg.SetDestination(_modules[row].address);
+	ilmsg::Processor.SendMessage(msg);
+}
+
+void LeverComManager::WheelInsert(byte row, unsigned long delay)
+{
+	unsigned long ticks = (delay + WheelResolution - 1) / WheelResolution;
+	if (ticks < 1)
+		ticks = 1;
+	else if (ticks > WheelSlots - 1)
+		ticks = WheelSlots - 1;
+
+	int bucket = (_wheelPos + ticks) % WheelSlots;
+	_modules[row].wheelNext = _wheel[bucket];
+	_wheel[bucket] = row;
+}
+
+void LeverComManager::Supervise(unsigned long now)
+{
+	// After a long stall each bucket is still visited only once
+	if (now - _wheelTime > WheelSlots * WheelResolution)
+		_wheelTime = now - WheelSlots * WheelResolution;
+
+	while (now - _wheelTime >= WheelResolution)
 	{
-		bool allowChange = true;
-		if (_onStateChanged)
-			allowChange = _onStateChanged(_info[dSlot]->lid, msg.state);
+		_wheelTime += WheelResolution;
+		_wheelPos = (_wheelPos + 1) % WheelSlots;
 
-		if (allowChange)
+		// Rows are filed by the deadline when they were last checked, a module heard from
+		// since then is filed again by its new deadline
+		byte row = _wheel[_wheelPos];
+		_wheel[_wheelPos] = NoModule;
+		while (row != NoModule)
 		{
-			_info[dSlot]->currentState = msg.state;
-			SendLockState(dSlot);
+			byte next = _modules[row].wheelNext;
+			unsigned long elapsed = now - _registeredDevices[_deviceIndex[_modules[row].address]].lastSeen;
+			if (elapsed >= _moduleTimeout)
+				SetModuleLost(row, true);
+			else
+				WheelInsert(row, _moduleTimeout - elapsed);
+			row = next;
 		}
 	}
 }
 
+void LeverComManager::SetModuleLost(byte row, bool lost)
+{
+	ModuleRow& module = _modules[row];
+	module.lost = lost;
+	module.supervised = !lost;
+
+	if (!_onLeverLost)
+		return;
+
+	const LeverInfo* info = &_info[row * SlotsPerModule];
+	for (int slot = 0; slot < SlotsPerModule; slot++)
+	{
+		if (info[slot].lid != ilock::Interlocking::faultLockId)
+			_onLeverLost(info[slot].lid, lost);
+	}
+}
+
+void LeverComManager::SetModuleTimeout(unsigned long ms)
+{
+	_moduleTimeout = ms < (WheelSlots - 1) * WheelResolution ? ms : (WheelSlots - 1) * WheelResolution;
+}
+
+bool LeverComManager::IsModuleAlive(DeviceId address) const
+{
+	return address <= lib::MaxModuleAddr && _moduleRows[address] != NoModule && _modules[_moduleRows[address]].supervised;
+}
+
+void LeverComManager::Tick()
+{
+	Supervise(millis());
+
+	for (byte row : _dirtyModules)
+	{
+		SendModuleLockState(row);
+		_modules[row].dirty = false;
+	}
+	_dirtyModules.clear();
+
+	// Push full state to one registered module per interval, so a whole frame powering up does not flood the bus
+	if (_resyncHead < _resyncModules.size())
+	{
+		unsigned long now = millis();
+		if (now - _lastResync >= _resyncInterval)
+		{
+			byte row = _resyncModules[_resyncHead++];
+			_modules[row].resync = false;
+			SendResync(row);
+			_lastResync = now;
+
+			if (_resyncHead == _resyncModules.size())
+			{
+				_resyncModules.clear();
+				_resyncHead = 0;
+			}
+		}
+	}
+}
+
+void LeverComManager::MarkSeen(DeviceId address, unsigned long now)
+{
+	if (address > lib::MaxModuleAddr || _deviceIndex[address] == NoModule)
+		return;
+
+	_registeredDevices[_deviceIndex[address]].lastSeen = now;
+
+	// Start supervising a lever module the first time it is heard from, or again after it was lost
+	byte row = _moduleRows[address];
+	if (row == NoModule || _modules[row].supervised)
+		return;
+
+	_modules[row].supervised = true;
+	WheelInsert(row, _moduleTimeout);
+	if (_modules[row].lost)
+		SetModuleLost(row, false);
+}
+
+void LeverComManager::OnHeartbeat(const ilmsg::MessageHeartbeat& msg)
+{
+	MarkSeen(msg.did, millis());
+}
+
+bool LeverComManager::OnRegister(const ilmsg::MessageRegister& msg)
+{
+	if (msg.did > lib::MaxModuleAddr)
+		return false;
+
+	// A module registering again has reset, keep its entry and refresh it
+	unsigned long now = millis();
+	bool added = _deviceIndex[msg.did] == NoModule;
+	if (added)
+	{
+		_deviceIndex[msg.did] = (byte)_registeredDevices.size();
+		_registeredDevices.push_back(RegisteredDevice{ msg.did, msg.mtype, now });
+	}
+	else
+	{
+		_registeredDevices[_deviceIndex[msg.did]].mtype = msg.mtype;
+	}
+	MarkSeen(msg.did, now);
+
+	// Queue a full lock state push, the module may have lost its indications
+	byte row = _moduleRows[msg.did];
+	if (row != NoModule && !_modules[row].resync)
+	{
+		_modules[row].resync = true;
+		_resyncModules.push_back(row);
+	}
+	return added;
+}
+
+Vector<DeviceId> LeverComManager::GetAddresses() const
+{
+	Vector<DeviceId> addresses;
+	for (const RegisteredDevice& device : _registeredDevices)
+		addresses.push_back(device.address);
+	return addresses;
+}
+
+void LeverComManager::OnSetLeverState(const ilmsg::MessageSetLeverState& msg)
+{
+	MarkSeen(msg.did, millis());
+
+	uint16_t idx = FindSlot(msg.did, msg.slot);
+	if (idx == NoIndex)
+		return;
+
+	LeverInfo& info = _info[idx];
+	if (msg.state == info.currentState)
+		return;
+
+	// The lever position is always tracked, but the lock state sent back comes from the interlocking.
+	// A locked lever keeps its lock state, so its module sees the mismatch and shows the fault
+	info.currentState = msg.state;
+	bool accepted = true;
+	LockState lockState = msg.state == LeverState::Normal ? LockState::On : LockState::Off;
+	if (_onStateChanged)
+	{
+		lockState = info.lockState;
+		accepted = _onStateChanged(info.lid, msg.state, lockState);
+	}
+
+	// A refused move is answered even though nothing changed, the module may have missed the last state
+	if (!accepted || lockState != info.lockState)
+	{
+		info.lockState = lockState;
+		UpdateLockState(idx);
+	}
+}
+
 void LeverComManager::Start()
 {
-	ilmsg::Processor.OnMessage(ilmsg::MessageType::SetLeverState, new ilmsg::MessageProcessFunc<ilmsg::MessageSetLeverState>(ManagerOnSetLeverState));
+	ilmsg::Processor.OnMessage<ilmsg::MessageSetLeverState, LeverComManager, &LeverComManager::OnSetLeverState>(this);
+	ilmsg::Processor.OnMessage<ilmsg::MessageHeartbeat, LeverComManager, &LeverComManager::OnHeartbeat>(this);
+	_wheelTime = millis();
 }
 
 LeverState LeverComManager::GetState(DeviceSlot slot)
 {
-	if (_info.find(slot) == _info.end())
+	uint16_t idx = FindSlot(slot.address, slot.slot);
+	if (idx == NoIndex)
 		return LeverState::Normal;
 
-	return _info[slot]->currentState;
+	return _info[idx].currentState;
 }
 
 void LeverComManager::SetLeverLockState(LockingId lid, bool locked)
 {
-	if (_slotMap.find(lid) == _slotMap.end())
+	if (lid >= _leverIndex.size() || _leverIndex[lid] == NoIndex)
 		return;
 
-	DeviceSlot dSlot = _slotMap[lid];
-	bool curLocked = _info[dSlot]->leverLocked;
-	_info[dSlot]->leverLocked = locked;
-	if (curLocked != locked)
+	uint16_t idx = _leverIndex[lid];
+	LeverInfo& info = _info[idx];
+	if (info.leverLocked != locked)
 	{
-		SendLockState(dSlot);
+		info.leverLocked = locked;
+		UpdateLockState(idx);
 	}
 }
 
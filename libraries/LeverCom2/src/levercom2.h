@@ -25,50 +25,168 @@ using ilock::LockingId;
 using ilock::LockState;
 using LeverState = ilock::Lever::State;
 
+//! Slots held for each module in the lever table
+constexpr int SlotsPerModule = ilmsg::ModuleLockSlots;
+
+//! Table index of a lever ID with no slot, and row of an address with no module
+constexpr uint16_t NoIndex = 0xFFFF;
+constexpr byte NoModule = 0xFF;
+
+//! Default time between full lock state pushes to registering modules in milliseconds
+constexpr unsigned long DefaultResyncInterval = 10;
+
+//! Default time without a message from a lever module before its levers are faulted, in milliseconds
+constexpr unsigned long DefaultModuleTimeout = 4 * ilmsg::HeartbeatInterval;
+
+//! Buckets of the module supervision timer wheel and time covered by each in milliseconds,
+//! the module timeout may be at most (WheelSlots - 1) * WheelResolution
+constexpr int WheelSlots = 16;
+constexpr unsigned long WheelResolution = 100;
+
 struct LeverInfo
 {
-	LockingId lid;
-	LockState lockState;
-	LeverState currentState;
-	bool leverLocked;
+	//! Lever in this slot, the fault lock ID for an empty slot
+	LockingId lid = ilock::Interlocking::faultLockId;
+	LockState lockState = LockState::On;
+	LeverState currentState = LeverState::Normal;
+	bool leverLocked = false;
 };
 
-typedef bool (*StateChangedFunc)(LockingId, LeverState);
+//! Module with a row in the lever table
+struct ModuleRow
+{
+	DeviceId address;
+	bool dirty;
+	//! Waiting for a full lock state push after registering
+	bool resync;
+	//! Heard from and held in the supervision timer wheel
+	bool supervised;
+	//! Timed out, its levers are faulted until it is heard from again
+	bool lost;
+	//! Next row in the same timer wheel bucket
+	byte wheelNext;
+};
+
+//! Module which has registered on the bus
+struct RegisteredDevice
+{
+	DeviceId address;
+	ilmsg::ModuleType mtype;
+	//! Time of the last message from the module in milliseconds
+	unsigned long lastSeen;
+};
+
+typedef bool (*StateChangedFunc)(LockingId, LeverState, LockState&);
+typedef void (*LeverLostFunc)(LockingId, bool);
+
+//! How lock states are sent to lever modules
+enum class LockSendMode : byte
+{
+	//! One SetLockState message for each changed lever
+	PerSlot,
+	//! One SetModuleLockState message for each changed module, sent by Tick
+	PerModule
+};
 
 class LeverComManager
 {
-	Map<LockingId, DeviceSlot> _slotMap;
-	MapComp<DeviceSlot, LeverInfo*, lib::DeviceSlotCompare> _info;
+	// Lever table, one row of SlotsPerModule slots for each module, indexed by module row and slot
+	Vector<LeverInfo> _info;
+	Vector<ModuleRow> _modules;
+	// Row of each module address
+	byte _moduleRows[lib::MaxModuleAddr + 1];
+	// Table index of each lever ID
+	Vector<uint16_t> _leverIndex;
 	StateChangedFunc _onStateChanged = nullptr;
 	bool _indicateLeverLocks = true;
-	Vector<DeviceId> _registeredDevices;
+	Vector<RegisteredDevice> _registeredDevices;
+	// Index in _registeredDevices of each module address
+	byte _deviceIndex[lib::MaxModuleAddr + 1];
+	LockSendMode _lockSendMode = LockSendMode::PerSlot;
+	// Rows of modules with lock state changes not sent yet, in PerModule mode
+	Vector<byte> _dirtyModules;
+	// Rows of registered modules waiting for a full lock state push, oldest first from _resyncHead
+	Vector<byte> _resyncModules;
+	size_t _resyncHead = 0;
+	unsigned long _resyncInterval = DefaultResyncInterval;
+	unsigned long _lastResync = 0;
+	// Supervision timer wheel, each bucket a list of rows linked through ModuleRow::wheelNext
+	byte _wheel[WheelSlots];
+	int _wheelPos = 0;
+	unsigned long _wheelTime = 0;
+	unsigned long _moduleTimeout = DefaultModuleTimeout;
+	LeverLostFunc _onLeverLost = nullptr;
+
+	//! Get table index of a device slot, NoIndex if no lever is registered there
+	uint16_t FindSlot(DeviceId address, SlotId slot) const
+	{
+		if (address > lib::MaxModuleAddr || slot >= SlotsPerModule || _moduleRows[address] == NoModule)
+			return NoIndex;
+
+		uint16_t idx = _moduleRows[address] * SlotsPerModule + slot;
+		return _info[idx].lid != ilock::Interlocking::faultLockId ? idx : NoIndex;
+	}
+	//! Get device slot of a table index
+	DeviceSlot GetDeviceSlot(uint16_t idx) const { return DeviceSlot{ _modules[idx / SlotsPerModule].address, (SlotId)(idx % SlotsPerModule) }; }
 
 	//! Process SetLeverState message
-	void OnSetLeverState(ilmsg::MessageSetLeverState msg);
-	//! Send lock state message to specified lever
-	void SendLockState(DeviceSlot dSlot);
+	void OnSetLeverState(const ilmsg::MessageSetLeverState& msg);
+	//! Send lock state message to the lever at the table index
+	void SendLockState(uint16_t idx);
+	//! Send the lock state of a lever now or mark its module for the next tick, depending on the mode
+	void UpdateLockState(uint16_t idx);
+	//! Send lock state message for all slots of the module row
+	void SendModuleLockState(byte row);
+	//! Send the full lock and indication state to the module row
+	void SendResync(byte row);
+	//! Update the last seen time of a registered module, starting its supervision if needed
+	void MarkSeen(DeviceId address, unsigned long now);
+	//! Process Heartbeat message
+	void OnHeartbeat(const ilmsg::MessageHeartbeat& msg);
+	//! Put a module row in the timer wheel bucket due after the delay in milliseconds
+	void WheelInsert(byte row, unsigned long delay);
+	//! Advance the timer wheel to now, faulting the levers of modules which timed out
+	void Supervise(unsigned long now);
+	//! Mark the levers of a module row lost or found again
+	void SetModuleLost(byte row, bool lost);
 
 public:
+	LeverComManager();
+
 	//! Start manager
 	void Start();
-	//! Register a lever device slot
-	void RegisterLever(DeviceSlot dSlot, LockingId lid, bool locked = false);
+	//! Register a lever device slot, returns false if the slot is outside the table or taken
+	bool RegisterLever(DeviceSlot dSlot, LockingId lid, bool locked = false);
 	//! Get lever state
 	LeverState GetState(DeviceSlot slot);
 	//! Get all addresses
-	Vector<DeviceId> GetAddresses() { return _registeredDevices; }
-	//! Callback for when lever state attempts to change
-	//! Returned bool can return false to deny change (ex: lever locked)
+	Vector<DeviceId> GetAddresses() const;
+	//! Get all registered modules
+	const Vector<RegisteredDevice>& GetDevices() const { return _registeredDevices; }
+	//! Callback for when a lever is thrown on its module. Sets the lock state argument to the
+	//! lever's lock state in the interlocking and returns whether the interlocking accepted the
+	//! move, false when the lever is locked and now faulted
 	void OnStateChanged(StateChangedFunc func) { _onStateChanged = func; }
+	//! Callback for when a lever is lost with its module timing out, or found again
+	void OnLeverLost(LeverLostFunc func) { _onLeverLost = func; }
+	//! Set time without a message from a lever module before its levers are lost, in milliseconds
+	void SetModuleTimeout(unsigned long ms);
+	//! Get whether a lever module has been heard from and has not timed out
+	bool IsModuleAlive(DeviceId address) const;
 	//! Set lock state
 	void SetLeverLockState(LockingId lid, bool locked);
 	//! Set whether lock indication is on
 	void SetLeverLockIndication(bool on);
+	//! Set how lock states are sent
+	void SetLockSendMode(LockSendMode mode) { _lockSendMode = mode; }
+	//! Set least time between full lock state pushes to registering modules in milliseconds
+	void SetResyncInterval(unsigned long ms) { _resyncInterval = ms; }
+	//! Supervise modules and send pending module lock states and resyncs, call once per loop
+	//! after applying changes
+	void Tick();
 
-	//! Process Register message
-	void OnRegister(ilmsg::MessageRegister msg);
-	//! Helper callback to process SetLeverState messages
-	static void ManagerOnSetLeverState(ilmsg::MessageSetLeverState msg);
+	//! Process Register message, returns false if the module was already registered
+	bool OnRegister(const ilmsg::MessageRegister& msg);
 };
 
 extern LeverComManager LeverManager;
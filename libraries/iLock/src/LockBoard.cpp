@@ -0,0 +1,135 @@
+/**
+* Interlocking library
+* Author: Kyle Sarnik
+**/
+
+#include "LockBoard.h"
+
+namespace ilock
+{
+
+void LockBoard::SetBit(Vector<Word>& bits, LockingId lid, bool set)
+{
+	if (set)
+		bits[WordIdx(lid)] |= Bit(lid);
+	else
+		bits[WordIdx(lid)] &= ~Bit(lid);
+}
+
+bool LockBoard::Build(Interlocking& interlocking)
+{
+	if (!interlocking.IsCompiled())
+		return false;
+
+	int count = interlocking.GetLockingCount();
+	if (count > MaxLockings)
+		return false;
+
+	_count = count;
+	_words = (count + WordBits - 1) / WordBits;
+	_states.assign(_words, 0);
+	_leverStates.assign(_words, 0);
+	_faulted.assign(_words, 0);
+	_isLever.assign(_words, 0);
+	_lockMasks.assign(count * 2 * _words, 0);
+
+	for (int i = 0; i < count; i++)
+	{
+		LockingId lid = (LockingId)i;
+		Locking* locking = interlocking.GetLockingFast(lid);
+
+		// Add this mechanism to the masks of each target it locks
+		for (LockState state : { LockState::On, LockState::Off })
+		{
+			const LockEdge* edge;
+			const LockEdge* end;
+			interlocking.GetLockEdges(lid, state, edge, end);
+			for (; edge != end; edge++)
+			{
+				if (edge->rule == Unlocked)
+					continue;
+
+				Word* mask = _lockMasks.data() + (edge->target * 2 + (int)state) * _words;
+				mask[WordIdx(lid)] |= Bit(lid);
+			}
+		}
+
+		SetBit(_states, lid, locking->GetState() == LockState::Off);
+		if (locking->IsLever())
+		{
+			Lever* lever = static_cast<Lever*>(locking);
+			SetBit(_isLever, lid, true);
+			SetBit(_leverStates, lid, lever->GetLeverState() == Lever::State::Reversed);
+			SetBit(_faulted, lid, lever->IsFaulted());
+		}
+	}
+
+	_countFaulted = interlocking.GetFaultedCount();
+	return true;
+}
+
+bool LockBoard::IsLockedIn(const Word* states, LockingId lid) const
+{
+	const Word* maskOn = GetLockMask(lid, LockState::On);
+	const Word* maskOff = GetLockMask(lid, LockState::Off);
+
+	Word locked = 0;
+	for (int w = 0; w < _words; w++)
+	{
+		locked |= (maskOn[w] & ~states[w]) | (maskOff[w] & states[w]);
+	}
+	return locked != 0;
+}
+
+bool LockBoard::ApplyLockState(LockingId lid, LockState state, bool ignoreLocked)
+{
+	if (!ignoreLocked && IsLocked(lid))
+		return false;
+
+	SetBit(_states, lid, state == LockState::Off);
+	return true;
+}
+
+bool LockBoard::TryToggleState(LockingId lid)
+{
+	if (IsLocked(lid))
+		return false;
+
+	_states[WordIdx(lid)] ^= Bit(lid);
+	return true;
+}
+
+void LockBoard::SetLeverState(LockingId lid, Lever::State newState)
+{
+	if (GetLeverState(lid) == newState)
+		return;
+
+	bool reversed = newState == Lever::State::Reversed;
+	if (reversed != TestBit(_states, lid))
+	{
+		TryToggleState(lid);
+	}
+
+	SetBit(_leverStates, lid, reversed);
+	SetLeverFaulted(lid, reversed != TestBit(_states, lid));
+}
+
+void LockBoard::ThrowLever(LockingId lid)
+{
+	TryToggleState(lid);
+	_leverStates[WordIdx(lid)] ^= Bit(lid);
+	SetLeverFaulted(lid, TestBit(_leverStates, lid) != TestBit(_states, lid));
+}
+
+void LockBoard::SetLeverFaulted(LockingId lid, bool faulted)
+{
+	bool currentlyFaulted = IsFaulted(lid);
+	if (faulted && !currentlyFaulted)
+		_countFaulted++;
+	else if (!faulted && currentlyFaulted)
+		_countFaulted--;
+
+	SetBit(_faulted, lid, faulted);
+}
+
+} // namespace ilock
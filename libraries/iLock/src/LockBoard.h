@@ -0,0 +1,99 @@
+/**
+* Interlocking library
+* Author: Kyle Sarnik
+**/
+
+#pragma once
+
+#include "iLock.h"
+
+namespace ilock {
+
+//! Alternative evaluation engine holding the state of a whole frame as bitsets.
+//! Each mechanism has one bit per set, locks are evaluated from precomputed masks
+//! of the mechanisms which lock it in each state. Answers match those of the
+//! Locking objects it was built from.
+class LockBoard
+{
+public:
+	typedef uint32_t Word;
+	constexpr static int WordBits = 32;
+	constexpr static int MaxLockings = 256;
+
+private:
+	int _count = 0;
+	int _words = 0;
+	int _countFaulted = 0;
+
+	// Bit set when the mechanism state is Off
+	Vector<Word> _states;
+	// Bit set when the lever is Reversed
+	Vector<Word> _leverStates;
+	Vector<Word> _faulted;
+	Vector<Word> _isLever;
+	// Mechanisms which lock each target, two masks per target for the acting state On and Off
+	Vector<Word> _lockMasks;
+
+	static Word Bit(LockingId lid) { return (Word)1 << (lid % WordBits); }
+	static int WordIdx(LockingId lid) { return lid / WordBits; }
+	static bool TestBit(const Vector<Word>& bits, LockingId lid) { return bits[WordIdx(lid)] & Bit(lid); }
+	static void SetBit(Vector<Word>& bits, LockingId lid, bool set);
+
+public:
+	//! Build masks from a compiled interlocking and copy its current state.
+	//! Returns false if the interlocking is not compiled or too large.
+	bool Build(Interlocking& interlocking);
+
+	//! Get number of mechanisms, including the fault lock
+	int GetCount() const { return _count; }
+
+	//! Get number of words in each bitset
+	int GetWordCount() const { return _words; }
+
+	//! Get whether the mechanism is currently locked, levers are also locked while any lever is faulted
+	bool IsLocked(LockingId lid) const { return (_countFaulted > 0 && IsLever(lid)) || IsLockedIn(_states.data(), lid); }
+
+	//! Get whether the mechanism would be locked by lock rules with the given state bitset
+	bool IsLockedIn(const Word* states, LockingId lid) const;
+
+	//! Get state of the mechanism
+	LockState GetState(LockingId lid) const { return TestBit(_states, lid) ? LockState::Off : LockState::On; }
+
+	//! Get state of the lever
+	Lever::State GetLeverState(LockingId lid) const { return TestBit(_leverStates, lid) ? Lever::State::Reversed : Lever::State::Normal; }
+
+	//! Get whether the lever is faulted
+	bool IsFaulted(LockingId lid) const { return TestBit(_faulted, lid); }
+
+	//! Get whether the mechanism is a lever
+	bool IsLever(LockingId lid) const { return TestBit(_isLever, lid); }
+
+	//! Get number of faulted levers
+	int GetFaultedCount() const { return _countFaulted; }
+
+	//! Apply lock state, potentially ignoring locked state. Returns whether the state was applied.
+	bool ApplyLockState(LockingId lid, LockState state, bool ignoreLocked = false);
+
+	//! Try to toggle the state of the mechanism. Returns whether it toggled.
+	bool TryToggleState(LockingId lid);
+
+	//! Set lever state, as Lever::SetLeverState
+	void SetLeverState(LockingId lid, Lever::State newState);
+
+	//! Throw lever, as Lever::ThrowLever
+	void ThrowLever(LockingId lid);
+
+	//! Sets lever as faulted
+	void SetLeverFaulted(LockingId lid, bool faulted);
+
+	//! Get the state bitset, a bit is set when the mechanism is Off
+	const Word* GetStates() const { return _states.data(); }
+
+	//! Get the mask of mechanisms which lock the target while in the given state
+	const Word* GetLockMask(LockingId target, LockState actingState) const
+	{
+		return _lockMasks.data() + (target * 2 + (int)actingState) * _words;
+	}
+};
+
+} // namespace ilock
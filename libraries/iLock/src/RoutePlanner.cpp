@@ -0,0 +1,188 @@
+/**
+* Interlocking library
+* Author: Kyle Sarnik
+**/
+
+#include "RoutePlanner.h"
+
+namespace ilock
+{
+
+namespace
+{
+bool TestState(const LockBoard::Word* states, LockingId lid)
+{
+	return states[lid / LockBoard::WordBits] & ((LockBoard::Word)1 << (lid % LockBoard::WordBits));
+}
+
+void ToggleState(LockBoard::Word* states, LockingId lid)
+{
+	states[lid / LockBoard::WordBits] ^= (LockBoard::Word)1 << (lid % LockBoard::WordBits);
+}
+
+bool InState(const LockBoard::Word* states, const LeverMove& move)
+{
+	return TestState(states, move.lid) == (move.state == Lever::State::Reversed);
+}
+} // namespace
+
+bool RoutePlanner::Build(Interlocking& interlocking)
+{
+	_routes.clear();
+	return _board.Build(interlocking);
+}
+
+int RoutePlanner::Remaining(const Word* states, const LeverMove* target, int count) const
+{
+	int remaining = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (!InState(states, target[i]))
+			remaining++;
+	}
+	return remaining;
+}
+
+bool RoutePlanner::Search(Word* states, const LeverMove* target, int count, int depth, int maxDepth, LockingId last, LeverMove* plan)
+{
+	// Each lever out of place needs at least one more move
+	int remaining = Remaining(states, target, count);
+	if (remaining == 0)
+		return true;
+	if (depth + remaining > maxDepth || ++_nodes > _maxNodes)
+		return false;
+
+	for (int i = 1; i < _board.GetCount(); i++)
+	{
+		LockingId lid = (LockingId)i;
+		if (lid == last || !_board.IsLever(lid) || _board.IsLockedIn(states, lid))
+			continue;
+
+		ToggleState(states, lid);
+		plan[depth] = LeverMove{ lid, TestState(states, lid) ? Lever::State::Reversed : Lever::State::Normal };
+		if (Search(states, target, count, depth + 1, maxDepth, lid, plan))
+			return true;
+		ToggleState(states, lid);
+	}
+	return false;
+}
+
+bool RoutePlanner::CopyStates(const Interlocking& live, Word* states) const
+{
+	for (int w = 0; w < MaxWords; w++)
+		states[w] = 0;
+
+	// Nothing can be planned while a lever is faulted
+	if (live.IsFaultLocked())
+		return false;
+
+	for (int i = 1; i < _board.GetCount() && i < live.GetLockingCount(); i++)
+	{
+		if (live.GetLockingFast((LockingId)i)->GetState() == LockState::Off)
+			ToggleState(states, (LockingId)i);
+	}
+	return true;
+}
+
+int RoutePlanner::PlanFrom(Word* states, const LeverMove* target, int count, LeverMove* plan, int capacity)
+{
+	_nodes = 0;
+	LeverMove moves[MaxPlanLength];
+	int maxDepth = capacity < MaxPlanLength ? capacity : MaxPlanLength;
+	for (int depth = Remaining(states, target, count); depth <= maxDepth; depth++)
+	{
+		if (Search(states, target, count, 0, depth, Interlocking::faultLockId, moves))
+		{
+			for (int i = 0; i < depth; i++)
+				plan[i] = moves[i];
+			return depth;
+		}
+		if (_nodes > _maxNodes)
+			break;
+	}
+	return -1;
+}
+
+int RoutePlanner::AddRoute(const String& name, const LeverMove* levers, int count)
+{
+	Route route;
+	route.name = name;
+	route.levers.assign(levers, levers + count);
+
+	// Plan from rest, all levers Normal
+	Word states[MaxWords] = {};
+	LeverMove plan[MaxPlanLength];
+	int length = PlanFrom(states, levers, count, plan, MaxPlanLength);
+	if (length >= 0)
+	{
+		route.plan.assign(plan, plan + length);
+		route.reachable = true;
+	}
+
+	_routes.push_back(route);
+	return (int)_routes.size() - 1;
+}
+
+int RoutePlanner::FindRoute(const String& name) const
+{
+	for (size_t i = 0; i < _routes.size(); i++)
+	{
+		if (_routes[i].name == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+int RoutePlanner::CheckPlan(Word* states, const Route& route, LeverMove* plan, int capacity) const
+{
+	int written = 0;
+	for (const LeverMove& move : route.plan)
+	{
+		if (InState(states, move))
+			continue;
+		if (_board.IsLockedIn(states, move.lid) || written >= capacity)
+			return -1;
+
+		ToggleState(states, move.lid);
+		plan[written++] = move;
+	}
+
+	if (Remaining(states, route.levers.data(), (int)route.levers.size()) > 0)
+		return -1;
+	return written;
+}
+
+int RoutePlanner::PlanRoute(int route, const Interlocking& live, LeverMove* plan, int capacity)
+{
+	if (route < 0 || route >= (int)_routes.size())
+		return -1;
+
+	Word states[MaxWords];
+	if (!CopyStates(live, states))
+		return -1;
+
+	// Cached plan first. Replaying it can reach the route from states off the plan with
+	// moves a search would not make, so it is only taken when no shorter plan can exist.
+	const Route& cached = _routes[route];
+	if (cached.reachable)
+	{
+		int lowerBound = Remaining(states, cached.levers.data(), (int)cached.levers.size());
+		int length = CheckPlan(states, cached, plan, capacity);
+		if (length == lowerBound)
+			return length;
+		CopyStates(live, states);
+	}
+
+	return PlanFrom(states, cached.levers.data(), (int)cached.levers.size(), plan, capacity);
+}
+
+int RoutePlanner::Plan(const LeverMove* target, int count, const Interlocking& live, LeverMove* plan, int capacity)
+{
+	Word states[MaxWords];
+	if (!CopyStates(live, states))
+		return -1;
+
+	return PlanFrom(states, target, count, plan, capacity);
+}
+
+} // namespace ilock
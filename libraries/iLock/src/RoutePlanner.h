@@ -0,0 +1,84 @@
+/**
+* Interlocking library
+* Author: Kyle Sarnik
+**/
+
+#pragma once
+
+#include "iLock.h"
+#include "LockBoard.h"
+
+namespace ilock {
+
+//! Named set of lever states with its cached plan from the rest state (all levers Normal)
+struct Route
+{
+	String name;
+	Vector<LeverMove> levers;
+	Vector<LeverMove> plan;
+	bool reachable = false;
+};
+
+//! Plans the shortest sequence of permitted lever moves to reach a set of lever states.
+//! Plans for configured routes are computed once at boot, a request at runtime checks
+//! the cached plan against the live state and only searches if it is no longer the shortest.
+class RoutePlanner
+{
+public:
+	constexpr static int MaxPlanLength = 32;
+	typedef LockBoard::Word Word;
+
+private:
+	LockBoard _board;
+	Vector<Route> _routes;
+	long _maxNodes = 100000;
+	long _nodes = 0;
+
+	constexpr static int MaxWords = LockBoard::MaxLockings / LockBoard::WordBits;
+
+	//! Get number of target levers not yet in their target state
+	int Remaining(const Word* states, const LeverMove* target, int count) const;
+
+	//! Iterative deepening search, depth-first up to maxDepth moves
+	bool Search(Word* states, const LeverMove* target, int count, int depth, int maxDepth, LockingId last, LeverMove* plan);
+
+	//! Copy lock states of the live interlocking, returns false if any lever is faulted
+	bool CopyStates(const Interlocking& live, Word* states) const;
+
+	//! Plan from the given states
+	int PlanFrom(Word* states, const LeverMove* target, int count, LeverMove* plan, int capacity);
+
+	//! Check a plan against the given states, writing the moves still needed to plan.
+	//! Returns the number of moves, or -1 if the plan is not valid from these states.
+	int CheckPlan(Word* states, const Route& route, LeverMove* plan, int capacity) const;
+
+public:
+	//! Build from a compiled interlocking
+	bool Build(Interlocking& interlocking);
+
+	//! Set how many search nodes a single plan may expand before giving up
+	void SetSearchLimit(long maxNodes) { _maxNodes = maxNodes; }
+
+	//! Add a route and compute its plan from the rest state, returns the route index
+	int AddRoute(const String& name, const LeverMove* levers, int count);
+
+	//! Find a route by name, -1 if not found
+	int FindRoute(const String& name) const;
+
+	//! Get route by index
+	const Route& GetRoute(int route) const { return _routes[route]; }
+
+	//! Get number of routes
+	int GetRouteCount() const { return (int)_routes.size(); }
+
+	//! Get the moves to set a route from the live state. Uses the cached plan when it still
+	//! applies and moves only levers out of place, otherwise searches. Returns the number of
+	//! moves written, -1 if no plan was found.
+	int PlanRoute(int route, const Interlocking& live, LeverMove* plan, int capacity);
+
+	//! Search for the shortest moves to reach the target lever states from the live state.
+	//! Returns the number of moves written, -1 if no plan was found.
+	int Plan(const LeverMove* target, int count, const Interlocking& live, LeverMove* plan, int capacity);
+};
+
+} // namespace ilock
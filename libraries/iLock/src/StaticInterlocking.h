@@ -0,0 +1,263 @@
+/**
+* Interlocking library
+* Author: Kyle Sarnik
+**/
+
+#pragma once
+
+#include "iLock.h"
+
+#include <string.h>
+
+namespace ilock {
+
+//! Lever entry of a generated config table
+struct StaticLeverData
+{
+	const char* name;
+	byte device;
+	byte slot;
+};
+
+//! Lock rule entry of a generated config table, rules are sorted by acting lever
+struct StaticLockRule
+{
+	LockingId acting;
+	LockingId target;
+	LockingRule ruleOn;
+	LockingRule ruleOff;
+};
+
+//! Interlocking for a fixed frame of levers, evaluated from constant tables generated from
+//! a config file at build time. Holds all state in fixed arrays and never allocates.
+//! Lever IDs match those Interlocking would assign: lever n of the table has ID n + 1.
+template <int NLevers>
+class StaticInterlocking
+{
+public:
+	constexpr static int Count = NLevers + 1;
+
+private:
+	const StaticLeverData* _levers;
+	const StaticLockRule* _rules;
+	// Rules of each ID, rules [offsets[lid], offsets[lid + 1]) act from that ID
+	const uint16_t* _ruleOffsets;
+
+	LockState _states[Count];
+	Lever::State _leverStates[Count];
+	bool _faulted[Count];
+	byte _lockCount[Count];
+	int _countFaulted = 0;
+
+	int _batchDepth = 0;
+	byte _batchPrevLocked[Count];
+	LockingId _batchTouched[Count];
+	int _batchTouchedCount = 0;
+
+	LockChangedFunc _onLockChange = nullptr;
+
+	constexpr static byte BatchUntouched = 0xFF;
+
+	static LockingRule RuleFor(const StaticLockRule& rule, LockState state)
+	{
+		return state == LockState::On ? rule.ruleOn : rule.ruleOff;
+	}
+
+	static bool IsLever(LockingId lid) { return lid > Interlocking::faultLockId && lid < Count; }
+
+	void LockChange(LockingId lid, bool locked)
+	{
+		if (_batchDepth > 0)
+		{
+			if (_batchPrevLocked[lid] == BatchUntouched)
+			{
+				_batchPrevLocked[lid] = !locked;
+				_batchTouched[_batchTouchedCount++] = lid;
+			}
+			return;
+		}
+
+		if (_onLockChange)
+			_onLockChange(lid, locked);
+	}
+
+	//! Move the lock count of the target, invoking the callback on a change of locked state
+	void ChangeLockCount(LockingId target, int delta)
+	{
+		bool wasLocked = IsLocked(target);
+		_lockCount[target] += delta;
+		if (IsLocked(target) != wasLocked)
+			LockChange(target, !wasLocked);
+	}
+
+	//! Apply the change of rules when the acting lever moves from one state to another
+	void ApplyLocks(LockingId acting, LockState from, LockState to)
+	{
+		for (uint16_t i = _ruleOffsets[acting]; i < _ruleOffsets[acting + 1]; i++)
+		{
+			const StaticLockRule& rule = _rules[i];
+			bool wasLocking = RuleFor(rule, from) != Unlocked;
+			bool willLock = RuleFor(rule, to) != Unlocked;
+			if (wasLocking != willLock)
+				ChangeLockCount(rule.target, willLock ? 1 : -1);
+		}
+	}
+
+	bool TryToggleState(LockingId lid)
+	{
+		if (IsLocked(lid))
+			return false;
+
+		LockState from = _states[lid];
+		_states[lid] = from == LockState::On ? LockState::Off : LockState::On;
+		ApplyLocks(lid, from, _states[lid]);
+		return true;
+	}
+
+public:
+	StaticInterlocking(const StaticLeverData* levers, const StaticLockRule* rules, const uint16_t* ruleOffsets) :
+		_levers(levers),
+		_rules(rules),
+		_ruleOffsets(ruleOffsets)
+	{
+		for (int i = 0; i < Count; i++)
+		{
+			_states[i] = LockState::On;
+			_leverStates[i] = Lever::State::Normal;
+			_faulted[i] = false;
+			_lockCount[i] = 0;
+			_batchPrevLocked[i] = BatchUntouched;
+		}
+	}
+
+	//! Apply the locks of every lever in its initial state, the equivalent of finalizing lock rules
+	void Init()
+	{
+		for (int i = 1; i < Count; i++)
+		{
+			for (uint16_t r = _ruleOffsets[i]; r < _ruleOffsets[i + 1]; r++)
+			{
+				if (RuleFor(_rules[r], _states[i]) != Unlocked)
+					ChangeLockCount(_rules[r].target, 1);
+			}
+		}
+	}
+
+	//! Get lever table entry, lid must be a lever ID
+	const StaticLeverData& GetLeverData(LockingId lid) const { return _levers[lid - 1]; }
+
+	//! Get lever name
+	const char* GetName(LockingId lid) const { return IsLever(lid) ? _levers[lid - 1].name : "fault"; }
+
+	//! Find lever by name, returns the fault lock ID if not found
+	LockingId FindLever(const char* name) const
+	{
+		for (int i = 0; i < NLevers; i++)
+		{
+			if (strcmp(_levers[i].name, name) == 0)
+				return (LockingId)(i + 1);
+		}
+		return Interlocking::faultLockId;
+	}
+
+	//! Get whether the lever is currently locked
+	bool IsLocked(LockingId lid) const { return _lockCount[lid] > 0 || (IsLever(lid) && _countFaulted > 0); }
+
+	//! Get lock state of the lever
+	LockState GetState(LockingId lid) const { return _states[lid]; }
+
+	//! Get lever state
+	Lever::State GetLeverState(LockingId lid) const { return _leverStates[lid]; }
+
+	//! Get whether the lever is faulted
+	bool IsFaulted(LockingId lid) const { return _faulted[lid]; }
+
+	//! Get number of faulted levers
+	int GetFaultedCount() const { return _countFaulted; }
+
+	//! Get whether the lever may be moved to the given state right now
+	bool CanMove(LockingId lid, Lever::State state) const
+	{
+		if (!IsLever(lid))
+			return false;
+
+		bool toOn = state == Lever::State::Normal;
+		if (toOn == (_states[lid] == LockState::On))
+			return true;
+		return !IsLocked(lid);
+	}
+
+	//! Set lever state, as Lever::SetLeverState
+	void SetLeverState(LockingId lid, Lever::State newState)
+	{
+		if (!IsLever(lid) || _leverStates[lid] == newState)
+			return;
+
+		LockState target = newState == Lever::State::Normal ? LockState::On : LockState::Off;
+		if (target != _states[lid])
+			TryToggleState(lid);
+
+		_leverStates[lid] = newState;
+		SetLeverFaulted(lid, target != _states[lid]);
+	}
+
+	//! Set lever faulted, as Interlocking::SetLeverFaulted
+	void SetLeverFaulted(LockingId lid, bool faulted)
+	{
+		if (!IsLever(lid) || faulted == _faulted[lid])
+			return;
+
+		_faulted[lid] = faulted;
+		int prevCount = _countFaulted;
+		_countFaulted += faulted ? 1 : -1;
+
+		// The fault gate holds every lever, only levers not already locked see a change
+		if ((prevCount == 0) != (_countFaulted == 0))
+		{
+			for (int i = 1; i < Count; i++)
+			{
+				if (_lockCount[i] == 0)
+					LockChange((LockingId)i, _countFaulted > 0);
+			}
+		}
+	}
+
+	//! Throw lever, as Lever::ThrowLever
+	void ThrowLever(LockingId lid)
+	{
+		if (!IsLever(lid))
+			return;
+
+		// A throw toggles the lock state even when the lever did not match it
+		TryToggleState(lid);
+		_leverStates[lid] = _leverStates[lid] == Lever::State::Normal ? Lever::State::Reversed : Lever::State::Normal;
+		LockState target = _leverStates[lid] == Lever::State::Normal ? LockState::On : LockState::Off;
+		SetLeverFaulted(lid, target != _states[lid]);
+	}
+
+	//! Set locking function callback
+	void OnLockChange(LockChangedFunc func) { _onLockChange = func; }
+
+	//! Begin a batch of changes, as Interlocking::BeginBatch
+	void BeginBatch() { _batchDepth++; }
+
+	//! Commit a batch, as Interlocking::CommitBatch
+	void CommitBatch()
+	{
+		if (_batchDepth == 0 || --_batchDepth > 0)
+			return;
+
+		for (int i = 0; i < _batchTouchedCount; i++)
+		{
+			LockingId lid = _batchTouched[i];
+			bool prevLocked = _batchPrevLocked[lid];
+			_batchPrevLocked[lid] = BatchUntouched;
+
+			if (IsLocked(lid) != prevLocked && _onLockChange)
+				_onLockChange(lid, IsLocked(lid));
+		}
+		_batchTouchedCount = 0;
+	}
+};
+
+} // namespace ilock
@@ -5,11 +5,13 @@
 
 #include "iLock.h"
 
+#include <algorithm>
+
 namespace ilock
 {
 
 #pragma region Operators
-const LockState& operator!(LockState& orig)
+LockState operator!(LockState orig)
 {
 	if (orig == LockState::On)
 		return LockState::Off;
@@ -17,7 +19,7 @@ const LockState& operator!(LockState& orig)
 		return LockState::On;
 }
 
-const Lever::State& operator!(Lever::State& orig)
+Lever::State operator!(Lever::State orig)
 {
 	if (orig == Lever::State::Normal)
 		return Lever::State::Reversed;
@@ -51,12 +53,14 @@ bool operator!=(const LockState& lhs, const Lever::State& rhs)
 }
 #pragma endregion Operators
 
+const LockingId Interlocking::faultLockId;
+
 void Locking::InitLockRule(const LockingId& lid)
 {
-	if (_lockingRules.find(lid) == _lockingRules.end())
+	if (!HasLockRule(lid))
 	{
 		LockRuleTable rules = LockRuleTable{ Unlocked, Unlocked, Unlocked };
-		_lockingRules.insert(std::make_pair(lid, rules));
+		_lockingRules.resize((size_t)lid + 1, rules);
 	}
 }
 
@@ -67,6 +71,12 @@ void Locking::AddLockRule(const LockState state, const LockingId lid, const Lock
 
 	InitLockRule(lid);
 
+	// Keep track of every mechanism this one applies rules to
+	if (std::find(_lockTargets.begin(), _lockTargets.end(), lid) == _lockTargets.end())
+	{
+		_lockTargets.push_back(lid);
+	}
+
 	if (state == LockState::On)
 	{
 		_lockingRules[lid]._locksWhenOn = rule;
@@ -83,45 +93,60 @@ void Locking::SetLock(const LockingId lid, const LockingRule rule)
 		return;
 
 	InitLockRule(lid);
-	_lockingRules[lid]._lockedBy = rule;
-	UpdateLockStatus();
+	LockingRule& lockedBy = _lockingRules[lid]._lockedBy;
+	bool wasLocking = lockedBy != Unlocked;
+	lockedBy = rule;
+
+	if (!wasLocking)
+		ChangeLockCount(1);
 }
 
 void Locking::WithdrawLock(const LockingId lid)
 {
-	if (_lockingRules[lid]._lockedBy == Unlocked)
+	if (!HasLockRule(lid) || _lockingRules[lid]._lockedBy == Unlocked)
 		return;
 
-	InitLockRule(lid);
 	_lockingRules[lid]._lockedBy = Unlocked;
-	UpdateLockStatus();
+	ChangeLockCount(-1);
 }
 
-void Locking::UpdateLockStatus()
+const Vector<LockingId>& Locking::GetCurrentLockedBy()
 {
-	bool _prevIsLocked = _isLocked;
-	_isLocked = false;
-	_curLockedBy.clear();
-	for (auto it = _lockingRules.begin(); it != _lockingRules.end(); it++)
+	// The fault gate is not a rule, so its state is tracked apart from rule changes
+	bool fault = IsLockedBy(Interlocking::faultLockId);
+	if (_curLockedByDirty || fault != _curLockedByFault)
 	{
-		if (it->second._lockedBy != Unlocked)
+		_curLockedBy.clear();
+		if (fault)
+			_curLockedBy.push_back(Interlocking::faultLockId);
+
+		for (size_t lid = 1; lid < _lockingRules.size() && _curLockedBy.size() < (size_t)_lockCount + fault; lid++)
 		{
-			_isLocked = true;
-			_curLockedBy.push_back(it->first);
+			if (_lockingRules[lid]._lockedBy != Unlocked)
+				_curLockedBy.push_back((LockingId)lid);
 		}
+		_curLockedByDirty = false;
+		_curLockedByFault = fault;
 	}
+	return _curLockedBy;
+}
+
+void Locking::ChangeLockCount(int delta)
+{
+	bool prevIsLocked = IsLocked();
+	_lockCount += delta;
+	_curLockedByDirty = true;
 
 	// Invoke callback
-	if ((_isLocked && !_prevIsLocked) ||
-		(!_isLocked && _prevIsLocked))
+	if (IsLocked() != prevIsLocked)
 	{
-		_interlocking->LockChange(_lid, _isLocked);
+		_interlocking->LockChange(_lid, IsLocked());
 	}
 }
 
 void Locking::ApplyLockState(LockState state, bool ignoreLocked)
 {
-	if (_isLocked && !ignoreLocked)
+	if (IsLocked() && !ignoreLocked)
 		return;
 
 	_state = state;
@@ -130,7 +155,7 @@ void Locking::ApplyLockState(LockState state, bool ignoreLocked)
 
 bool Locking::TryToggleState()
 {
-	if (_isLocked)
+	if (IsLocked())
 		return false;
 
 	_state = !_state;
@@ -140,20 +165,47 @@ bool Locking::TryToggleState()
 }
 
 
+LockingRule Locking::GetLockRule(LockState state, LockingId lid) const
+{
+	if (!HasLockRule(lid))
+		return Unlocked;
+
+	if (state == LockState::On)
+		return _lockingRules[lid]._locksWhenOn;
+	else
+		return _lockingRules[lid]._locksWhenOff;
+}
+
 void Locking::ApplyLocks(LockState state)
 {
-	for (auto it = _lockingRules.begin(); it != _lockingRules.end(); it++)
+	// Use compiled lock graph if available
+	if (_interlocking->IsCompiled())
 	{
-		Locking* other = _interlocking->GetLocking(it->first);
+		const LockEdge* edge;
+		const LockEdge* end;
+		_interlocking->GetLockEdges(_lid, state, edge, end);
+		for (; edge != end; edge++)
+		{
+			Locking* other = _interlocking->GetLockingFast(edge->target);
+			if (edge->rule == Unlocked)
+			{
+				other->WithdrawLock(_lid);
+			}
+			else
+			{
+				other->SetLock(_lid, edge->rule);
+			}
+		}
+		return;
+	}
+
+	for (LockingId lid : _lockTargets)
+	{
+		Locking* other = _interlocking->GetLocking(lid);
 		if (!other)
 			continue;
 
-		LockingRule rule = Unlocked;
-		if (state == LockState::On)
-			rule = it->second._locksWhenOn;
-		else if (state == LockState::Off)
-			rule = it->second._locksWhenOff;
-
+		LockingRule rule = GetLockRule(state, lid);
 		if (rule == Unlocked)
 		{
 			other->WithdrawLock(_lid);
@@ -170,6 +222,12 @@ void Locking::FinalizeLockRules()
 	if (_lockingFinalized)
 		return;
 
+	// Size the rule array for every ID so locks set later never reallocate
+	InitLockRule(_interlocking->GetLockingCount() - 1);
+	_lockingRules.shrink_to_fit();
+	_lockTargets.shrink_to_fit();
+	_curLockedBy.reserve(_interlocking->GetLockingCount());
+
 	ApplyLocks(_state);
 
 	_lockingFinalized = true;
@@ -200,10 +258,7 @@ void Lever::ThrowLever()
 
 Locking* Interlocking::GetLocking(LockingId id)
 {
-	if (id == faultLockId)
-		return &_faultLock;
-
-	if (_allLocks.find(id) == _allLocks.end())
+	if (id >= _allLocks.size())
 		return nullptr;
 
 	return _allLocks[id];
@@ -211,33 +266,24 @@ Locking* Interlocking::GetLocking(LockingId id)
 
 void Interlocking::SetLeverFaulted(LockingId lever, bool faulted)
 {
-	bool currentlyFaulted = false;
-	if (_faultedLevers.find(lever) != _faultedLevers.end())
-	{
-		currentlyFaulted = _faultedLevers[lever];
-	}
-
-	// Update faulted count only if status changed
-	if (faulted && !currentlyFaulted)
-	{
-		_countFaulted++;
-	}
-	else if (!faulted && currentlyFaulted)
-	{
-		_countFaulted--;
-	}
+	// Nothing to do unless the status changed
+	if (lever >= _faultedLevers.size() || (bool)_faultedLevers[lever] == faulted)
+		return;
 
-	// Keep track of fault status
 	_faultedLevers[lever] = faulted;
+	bool wasFaultLocked = IsFaultLocked();
+	_countFaulted += faulted ? 1 : -1;
 
-	// Apply lock
-	if (_countFaulted > 0)
-	{
-		_faultLock.ApplyLockState(LockState::On, true);
-	}
-	else
+	// The gate only changes the locked state of levers when the faulted count crosses zero,
+	// and then only for levers not already held by a rule
+	if (IsFaultLocked() == wasFaultLocked)
+		return;
+
+	for (size_t lid = 1; lid < _allLocks.size(); lid++)
 	{
-		_faultLock.ApplyLockState(LockState::Off, true);
+		Locking* locking = _allLocks[lid];
+		if (locking->IsLever() && locking->GetLockCount() == 0)
+			LockChange((LockingId)lid, IsFaultLocked());
 	}
 }
 
@@ -245,14 +291,9 @@ Lever* Interlocking::AddLever(String name)
 {
 	_lockNames.insert(std::make_pair(name, _nextId));
 	Lever* lever = new Lever(_nextId, *this, name);
-	_allLocks[_nextId] = lever;
-
-	// Make this lever locked when the fault lock is on
-	_faultLock.AddLockRule(LockState::On, _nextId, LockedAny);
-	_faultLock.AddLockRule(LockState::Off, _nextId, Unlocked);
-
-	// Add to fault map
-	_faultedLevers.insert(std::make_pair(_nextId, false));
+	_allLocks.push_back(lever);
+	_faultedLevers.push_back(false);
+	_compiled = false;
 
 	// Increment the id before returning
 	_nextId++;
@@ -263,9 +304,12 @@ Locking* Interlocking::AddLocking(String name)
 {
 	_lockNames.insert(std::make_pair(name, _nextId));
 	Locking* locking = new Locking(_nextId, *this, name);
+	_allLocks.push_back(locking);
+	_faultedLevers.push_back(false);
+	_compiled = false;
 
 	// Increment the id after returning it
-	_allLocks[_nextId++] = locking;
+	_nextId++;
 	return locking;
 }
 
@@ -280,18 +324,165 @@ Locking* Interlocking::GetLocking(String name)
 Vector<LockingId> Interlocking::GetAllLockings()
 {
 	Vector<LockingId> ids = Vector<LockingId>();
-	for (auto it = _allLocks.begin(); it != _allLocks.end(); it++)
+	for (size_t lid = 1; lid < _allLocks.size(); lid++)
 	{
-		ids.push_back(it->first);
+		ids.push_back((LockingId)lid);
 	}
 	return ids;
 }
 
+bool Interlocking::Compile()
+{
+	_edgeOffsets.clear();
+	_edges.clear();
+	_compiled = false;
+
+	// Offsets are 16 bit, a graph with more edges stays on the uncompiled path
+	size_t edgeCount = 0;
+	for (Locking* locking : _allLocks)
+	{
+		for (LockingId target : locking->GetLockTargets())
+		{
+			if (target < _allLocks.size())
+				edgeCount += 2;
+		}
+	}
+	if (edgeCount > MaxEdges)
+	{
+		_edgeOffsets.shrink_to_fit();
+		_edges.shrink_to_fit();
+		return false;
+	}
+
+	_edgeOffsets.reserve(_allLocks.size() * 2 + 1);
+	_edges.reserve(edgeCount);
+
+	// Lay out the edges of every ID, state On first then Off
+	for (Locking* locking : _allLocks)
+	{
+		for (LockState state : { LockState::On, LockState::Off })
+		{
+			_edgeOffsets.push_back((uint16_t)_edges.size());
+			for (LockingId target : locking->GetLockTargets())
+			{
+				if (target >= _allLocks.size())
+					continue;
+
+				_edges.push_back(LockEdge{ target, locking->GetLockRule(state, target) });
+			}
+		}
+	}
+	_edgeOffsets.push_back((uint16_t)_edges.size());
+
+	_edgeOffsets.shrink_to_fit();
+	_edges.shrink_to_fit();
+	_compiled = true;
+	return true;
+}
+
 void Interlocking::LockChange(LockingId id, bool locked)
 {
+	if (InBatch())
+	{
+		// Only the state before the first change matters for the net change
+		if (id < _batchPrevLocked.size() && _batchPrevLocked[id] == BatchUntouched)
+		{
+			_batchPrevLocked[id] = !locked;
+			_batchTouched.push_back(id);
+		}
+		return;
+	}
+
 	if (_onLockChange)
 		_onLockChange(id, locked);
 }
 
+void Interlocking::BeginBatch()
+{
+	if (_batchDepth++ > 0)
+		return;
+
+	if (_batchPrevLocked.size() != _allLocks.size())
+	{
+		_batchPrevLocked.assign(_allLocks.size(), BatchUntouched);
+		_batchTouched.reserve(_allLocks.size());
+	}
+}
+
+void Interlocking::CommitBatch()
+{
+	if (_batchDepth == 0 || --_batchDepth > 0)
+		return;
+
+	for (LockingId id : _batchTouched)
+	{
+		bool prevLocked = _batchPrevLocked[id];
+		_batchPrevLocked[id] = BatchUntouched;
+
+		bool locked = _allLocks[id]->IsLocked();
+		if (locked != prevLocked && _onLockChange)
+			_onLockChange(id, locked);
+	}
+	_batchTouched.clear();
+}
+
+bool Interlocking::CanMove(LockingId lid, Lever::State state) const
+{
+	if (lid >= _allLocks.size() || !_allLocks[lid]->IsLever())
+		return false;
+
+	// Moving to the current lock state changes nothing in the interlocking
+	const Locking* locking = _allLocks[lid];
+	if (state == locking->GetState())
+		return true;
+
+	return !locking->IsLocked();
+}
+
+int Interlocking::CanMove(const LeverMove* moves, int count, bool* results) const
+{
+	int permitted = 0;
+	for (int i = 0; i < count; i++)
+	{
+		results[i] = CanMove(moves[i].lid, moves[i].state);
+		if (results[i])
+			permitted++;
+	}
+	return permitted;
+}
+
+int Interlocking::QueryMoveEffects(LockingId lid, Lever::State state, MoveEffect* effects, int capacity) const
+{
+	if (!_compiled || !CanMove(lid, state))
+		return 0;
+
+	const Locking* locking = _allLocks[lid];
+	LockState newState = state == Lever::State::Normal ? LockState::On : LockState::Off;
+	if (newState == locking->GetState())
+		return 0;
+
+	// Both spans list the same targets in the same order
+	const LockEdge* edge;
+	const LockEdge* end;
+	GetLockEdges(lid, newState, edge, end);
+
+	int written = 0;
+	for (; edge != end && written < capacity; edge++)
+	{
+		const Locking* other = _allLocks[edge->target];
+		bool wasLocking = other->IsLockedBy(lid);
+		bool willLock = edge->rule != Unlocked;
+
+		if (willLock && !wasLocking && !other->IsLocked())
+		{
+			effects[written++] = MoveEffect{ edge->target, true };
+		}
+		else if (!willLock && wasLocking && other->GetLockCount() == 1)
+		{
+			effects[written++] = MoveEffect{ edge->target, false };
+		}
+	}
+	return written;
+}
+
 } // namespace ilock
-	
\ No newline at end of file
@@ -38,7 +38,15 @@ struct LockRuleTable
 class Interlocking;
 
 typedef byte LockingId;
-typedef Map<LockingId, LockRuleTable> LockMap;
+//! Lock rule tables indexed directly by LockingId
+typedef Vector<LockRuleTable> LockRuleArray;
+
+//! Entry of the compiled lock graph, rule applied to a target when the acting mechanism enters a state
+struct LockEdge
+{
+	LockingId target;
+	LockingRule rule;
+};
 
 //! Base class for some locking mechanism, which interlocks with other mechanisms
 class Locking
@@ -47,10 +55,14 @@ protected:
 	LockingId _lid;
 	LockState _state;
 	Interlocking* _interlocking = nullptr;
-	LockMap _lockingRules;
-	bool _isLocked = false;
+	LockRuleArray _lockingRules;
+	Vector<LockingId> _lockTargets;
+	int _lockCount = 0;
 	Vector<LockingId> _curLockedBy;
+	bool _curLockedByDirty = false;
+	bool _curLockedByFault = false;
 	bool _lockingFinalized = false;
+	bool _isLever = false;
 	String _name;
 
 public:
@@ -80,11 +92,17 @@ public:
 	//! Withdraw the lock on this mechanism applied by the specified ID
 	void WithdrawLock(const LockingId lockedBy);
 
-	//! Get whether this mechanism is currently locked
-	bool IsLocked() { return _isLocked; }
+	//! Get whether this mechanism is currently locked, levers are also locked while the fault gate is closed
+	bool IsLocked() const;
 
-	//! Get what is currently locking this mechanism
-	const Vector<LockingId>& GetCurrentLockedBy() { return _curLockedBy; }
+	//! Get number of mechanisms currently locking this one, not counting the fault gate
+	int GetLockCount() const { return _lockCount; }
+
+	//! Get whether the specified ID currently holds a lock on this mechanism
+	bool IsLockedBy(const LockingId lid) const;
+
+	//! Get what is currently locking this mechanism, built on request
+	const Vector<LockingId>& GetCurrentLockedBy();
 
 	//! Get parent interlocking
 	const Interlocking* GetInterlocking() { return _interlocking; }
@@ -93,7 +111,10 @@ public:
 	void ApplyLockState(LockState state, bool ignoreLocked = false);
 
 	//! Get state of lock
-	LockState GetState() { return _state; }
+	LockState GetState() const { return _state; }
+
+	//! Get whether this mechanism is a lever
+	bool IsLever() const { return _isLever; }
 
 	//! Finalize all locks rules, should be invoked after adding all lock rules
 	void FinalizeLockRules();
@@ -101,20 +122,29 @@ public:
 	//! Get name
 	const String& GetName() { return _name; }
 
+	//! Get IDs of all mechanisms this one applies rules to
+	const Vector<LockingId>& GetLockTargets() const { return _lockTargets; }
+
+	//! Get rule applied to the target when this mechanism is in the given state
+	LockingRule GetLockRule(LockState state, LockingId lid) const;
+
 protected:
 	//! Try to toggle the state of the mechanism. Returns whether it toggled. 
 	bool TryToggleState();
 
 private:
-	//! Update status of the locked flag. Should be called any type a lock is set or withdrawn
-	//! or whenever the lock state changes
-	void UpdateLockStatus();
+	//! Adjust the count of active locks. Should be called whenever a lock is set or withdrawn,
+	//! invokes the lock change callback when the count moves to or from zero
+	void ChangeLockCount(int delta);
 
 	//! Apply locks to all interlocked mechanisms
 	void ApplyLocks(LockState state);
 
-	//! Init a lock rule
+	//! Init a lock rule, growing the rule array to hold the ID if needed
 	void InitLockRule(const LockingId& lid);
+
+	//! Get whether a rule table exists for the ID
+	bool HasLockRule(const LockingId& lid) const { return lid < _lockingRules.size(); }
 };
 
 // Class for a interlocking lever
@@ -133,7 +163,10 @@ private:
 
 public:
 	Lever(LockingId lid, Interlocking& interlocking, const String& name) 
-		: Locking(lid, interlocking, name) {}
+		: Locking(lid, interlocking, name)
+	{
+		_isLever = true;
+	}
 
 	//! Set lever state
 	void SetLeverState(State newState);
@@ -142,10 +175,24 @@ public:
 	void ThrowLever();
 
 	//! Get whether the lever is faulted
-	bool IsFaulted() { return _isFaulted; }
+	bool IsFaulted() const { return _isFaulted; }
 
 	//! Get current lever state
-	const State GetLeverState() { return _leverState; }
+	const State GetLeverState() const { return _leverState; }
+};
+
+//! Candidate lever move for a query
+struct LeverMove
+{
+	LockingId lid;
+	Lever::State state;
+};
+
+//! Change in locked state a move would cause
+struct MoveEffect
+{
+	LockingId lid;
+	bool locked;
 };
 
 typedef void (*LockChangedFunc)(LockingId, bool);
@@ -155,22 +202,40 @@ class Interlocking
 {
 public:
 	const static LockingId faultLockId = 0;
+	//! Most edges a compiled lock graph holds, the offsets into them are 16 bit
+	constexpr static size_t MaxEdges = 0xFFFF;
 
 private:
 	Map<String, LockingId> _lockNames;
-	Map<LockingId, Locking*> _allLocks;
-	Map<LockingId, bool> _faultedLevers;
+	Vector<Locking*> _allLocks;
+	// Faulted flag of each ID, while any lever is faulted the fault gate holds every lever
+	Vector<byte> _faultedLevers;
 	int _countFaulted = 0;
 	Locking _faultLock;
 	LockingId _nextId = 1;
 
+	// Compiled lock graph, edges for each ID and state are stored contiguously
+	Vector<uint16_t> _edgeOffsets;
+	Vector<LockEdge> _edges;
+	bool _compiled = false;
+
 	//! Callback function for when a lock state changes
 	LockChangedFunc _onLockChange = nullptr;
 
+	// Batched lock changes, locked state of each touched ID when first changed in the batch
+	int _batchDepth = 0;
+	Vector<byte> _batchPrevLocked;
+	Vector<LockingId> _batchTouched;
+
+	constexpr static byte BatchUntouched = 0xFF;
+
 public:
 	Interlocking() :
 		_faultLock(faultLockId, *this, "fault")
-	{}
+	{
+		_allLocks.push_back(&_faultLock);
+		_faultedLevers.push_back(false);
+	}
 
 	//! Get lock mechanism by its id
 	Locking* GetLocking(LockingId lid);
@@ -178,6 +243,15 @@ public:
 	//! Sets lever as faulted
 	void SetLeverFaulted(LockingId id, bool faulted);
 
+	//! Get number of faulted levers
+	int GetFaultedCount() const { return _countFaulted; }
+
+	//! Get whether the fault gate is closed, holding every lever locked
+	bool IsFaultLocked() const { return _countFaulted > 0; }
+
+	//! Get whether the lever is marked faulted
+	bool IsLeverFaulted(LockingId id) const { return id < _faultedLevers.size() && _faultedLevers[id]; }
+
 	//! Add lever with given name
 	Lever* AddLever(String name);
 
@@ -190,11 +264,69 @@ public:
 	//! Get all lockings
 	Vector<LockingId> GetAllLockings();
 
+	//! Get number of IDs in use, including the fault lock
+	int GetLockingCount() const { return (int)_allLocks.size(); }
+
+	//! Compile all lock rules into a single lock graph, should be invoked after all
+	//! lock rules are finalized. Adding mechanisms afterwards discards the graph.
+	//! Returns false and leaves the interlocking uncompiled if the graph has more than MaxEdges edges.
+	bool Compile();
+
+	//! Get whether the lock graph is compiled
+	bool IsCompiled() const { return _compiled; }
+
+	//! Get the compiled edges applied when the mechanism enters the given state
+	void GetLockEdges(LockingId lid, LockState state, const LockEdge*& begin, const LockEdge*& end) const
+	{
+		int idx = lid * 2 + (int)state;
+		begin = _edges.data() + _edgeOffsets[idx];
+		end = _edges.data() + _edgeOffsets[idx + 1];
+	}
+
+	//! Get lock mechanism by its id without bounds checking
+	Locking* GetLockingFast(LockingId lid) const { return _allLocks[lid]; }
+
 	//! Set locking function callback
 	void OnLockChange(LockChangedFunc func) { _onLockChange = func; }
 
-	//! Invoke lock change callback
+	//! Invoke lock change callback, deferred until commit while a batch is open
 	void LockChange(LockingId id, bool locked);
+
+	//! Begin a batch of changes, lock change callbacks are held until the batch is committed.
+	//! Batches may be nested, only the outermost commit emits callbacks.
+	void BeginBatch();
+
+	//! Commit a batch, invoking the lock change callback once for each ID whose
+	//! locked state differs from when the batch began
+	void CommitBatch();
+
+	//! Get whether a batch is open
+	bool InBatch() const { return _batchDepth > 0; }
+
+	//! Get whether the lever may be moved to the given state right now, without changing anything
+	bool CanMove(LockingId lid, Lever::State state) const;
+
+	//! Check a list of candidate moves, each against the current state. Writes whether each
+	//! move is permitted to results and returns the number permitted.
+	int CanMove(const LeverMove* moves, int count, bool* results) const;
+
+	//! Get the mechanisms which would become locked or unlocked if the lever moved to the given state.
+	//! Writes up to capacity effects and returns the number written, zero if the move is not permitted
+	//! or the lock graph is not compiled.
+	int QueryMoveEffects(LockingId lid, Lever::State state, MoveEffect* effects, int capacity) const;
 };
 
+inline bool Locking::IsLocked() const
+{
+	return _lockCount > 0 || (_isLever && _interlocking->IsFaultLocked());
+}
+
+inline bool Locking::IsLockedBy(const LockingId lid) const
+{
+	if (lid == Interlocking::faultLockId)
+		return _isLever && _interlocking->IsFaultLocked();
+
+	return HasLockRule(lid) && _lockingRules[lid]._lockedBy != Unlocked;
+}
+
 } // namespace ilock